@@ -0,0 +1,88 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <sys/resource.h>
+
+/*bench目录下各个基准程序共用的小工具：计时、延迟分位数、进程内存、fd上限。
+每个基准程序单独编译(在6hook目录下)，不参与本阶段的 g++ *.cpp：
+g++ -O2 -std=c++17 bench/<name>.cpp $(ls *.cpp | grep -v test.cpp) -o <name> -ldl -lpthread*/
+
+//单调时钟，纳秒
+static inline uint64_t bench_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//延迟样本，单位微秒
+struct BenchLatency
+{
+    std::vector<double> samples;
+
+    void add(double us) {samples.push_back(us);}
+
+    //p取0~100，调用前先sort
+    double percentile(double p) const
+    {
+        if(samples.empty())
+        {
+            return 0;
+        }
+        size_t i = (size_t)(p / 100.0 * (samples.size() - 1) + 0.5);
+        return samples[std::min(i, samples.size() - 1)];
+    }
+
+    void print(const char* name)
+    {
+        std::sort(samples.begin(), samples.end());
+        printf("%-24s n=%-7zu p50=%8.1f us  p99=%8.1f us  p99.9=%8.1f us  max=%8.1f us\n",
+               name, samples.size(), percentile(50), percentile(99), percentile(99.9),
+               samples.empty() ? 0.0 : samples.back());
+    }
+};
+
+//读/proc/self/status中的一项(VmRSS、VmSize等)，单位KB
+static inline long bench_proc_kb(const char* key)
+{
+    FILE* f = fopen("/proc/self/status", "r");
+    if(!f)
+    {
+        return -1;
+    }
+    char line[256];
+    long kb = -1;
+    size_t n = strlen(key);
+    while(fgets(line, sizeof(line), f))
+    {
+        if(strncmp(line, key, n) == 0 && line[n] == ':')
+        {
+            kb = atol(line + n + 1);
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+//尽量提高RLIMIT_NOFILE，返回实际生效的上限
+static inline rlim_t bench_raise_nofile(rlim_t want)
+{
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    if(rl.rlim_cur < want)
+    {
+        rl.rlim_cur = std::min(want, rl.rlim_max);
+        setrlimit(RLIMIT_NOFILE, &rl);
+        getrlimit(RLIMIT_NOFILE, &rl);
+    }
+    return rl.rlim_cur;
+}
+
+#endif
@@ -0,0 +1,73 @@
+#include "../ioscheduler.h"
+#include "../channel.h"
+#include "bench.h"
+#include <thread>
+#include <atomic>
+
+/*Channel<long>在8个worker上的吞吐量。
+  SPSC      一个生产者一个消费者，有界(1024)、无界、容量0(rendezvous，每个元素都要一次直接交接)
+  MPMC      8个生产者8个消费者，容量1024
+  MPSC      64个生产者1个消费者，容量64
+每种情况都校验收到的元素个数和总和。
+
+编译(在6hook目录下)：
+g++ -O2 -std=c++17 bench/channel_throughput.cpp $(ls *.cpp | grep -v test.cpp) -o channel_throughput -ldl -lpthread
+运行：./channel_throughput [元素个数=1000000]，rendezvous只用其中的1/5*/
+
+static void run(const char* name, size_t cap, int producers, int consumers, long total)
+{
+    john::Channel<long> ch(cap);
+    std::atomic<long> sum{0}, got{0};
+    std::atomic<int> done{0};
+    long per = total / producers;
+    uint64_t start = bench_now_ns();
+    {
+        //8个worker线程，主线程在stop()时加入
+        john::IOManager iom(9, true, name);
+        for(int p = 0; p < producers; ++p)
+        {
+            iom.schedulerLock([&ch, &done, per, producers]()
+            {
+                for(long i = 0; i < per; ++i)
+                {
+                    ch.send(i);
+                }
+                if(++done == producers)
+                {
+                    ch.close();
+                }
+            });
+        }
+        for(int c = 0; c < consumers; ++c)
+        {
+            iom.schedulerLock([&ch, &sum, &got]()
+            {
+                long v, s = 0, n = 0;
+                while(ch.recv(v))
+                {
+                    s += v;
+                    ++n;
+                }
+                sum += s;
+                got += n;
+            });
+        }
+        iom.stop();
+    }
+    double secs = (bench_now_ns() - start) / 1e9;
+    long expect = (long)producers * per * (per - 1) / 2;
+    printf("%-24s %8ld items (%s) in %6.3f s  %6.2f M/s\n", name, got.load(),
+           sum == expect && got == per * producers ? "ok" : "WRONG", secs, got / secs / 1e6);
+}
+
+int main(int argc, char** argv)
+{
+    long total = argc > 1 ? atol(argv[1]) : 1000000;
+    printf("%u CPUs, 8 workers\n", std::thread::hardware_concurrency());
+    run("SPSC cap=1024", 1024, 1, 1, total);
+    run("SPSC unbounded", john::Channel<long>::UNBOUNDED, 1, 1, total);
+    run("SPSC cap=0 (rendezvous)", 0, 1, 1, total / 5);
+    run("MPMC 8p/8c cap=1024", 1024, 8, 8, total);
+    run("MPSC 64p/1c cap=64", 64, 64, 1, total);
+    return 0;
+}
@@ -0,0 +1,149 @@
+#include "../ioscheduler.h"
+#include "../hook.h"
+#include "../coro.h"
+#include "bench.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#if __cplusplus < 202002L
+#error "coro_memory needs -std=c++20"
+#endif
+
+/*N个空闲连接时，每个连接的处理者占用多少内存：Fiber对比C++20无栈协程Task。
+两种echo服务器都在4个worker上运行，处理者各有一个4KB的读缓冲区：
+  fiber  每个连接一个Fiber，用hook后的read/write，挂起时保留128KB的协程栈
+  coro   每个连接一个Task，co_await readable()后用原始的read_f/write_f，挂起时只保留堆上的协程帧
+主线程作为普通线程的客户端建立N个连接，每个连接收发一个字节，确认处理者已经运行并挂起在下一次读上，
+再比较连接前后的VmRSS和VmSize。两种模式分别在fork出的子进程中运行，互不影响。
+
+编译(在6hook目录下)：
+g++ -O2 -std=c++20 bench/coro_memory.cpp $(ls *.cpp | grep -v test.cpp) -o coro_memory -ldl -lpthread
+运行：./coro_memory [连接数=5000]，每个连接占用两个fd，连接数受RLIMIT_NOFILE限制*/
+
+static const size_t BUF_SIZE = 4096;
+
+static void fiber_echo(int fd)
+{
+    char buf[BUF_SIZE];
+    while(true)
+    {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if(n <= 0 || write(fd, buf, n) != n)
+        {
+            break;
+        }
+    }
+    close(fd);
+}
+
+static john::Task<> coro_echo(int fd)
+{
+    char buf[BUF_SIZE];
+    while(true)
+    {
+        ssize_t n = read_f(fd, buf, sizeof(buf));
+        if(n < 0 && errno == EAGAIN)
+        {
+            co_await john::readable(fd);
+            continue;
+        }
+        if(n <= 0 || write_f(fd, buf, n) != n)
+        {
+            break;
+        }
+    }
+    close(fd);
+}
+
+static int run(bool coro, long conns)
+{
+    //4个worker线程，主线程不参与调度，测量结束后直接_exit
+    john::IOManager iom(4, false, coro ? "coro" : "fiber", true);
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if(bind(listen_fd, (sockaddr*)&addr, len) < 0 || listen(listen_fd, SOMAXCONN) < 0
+       || getsockname(listen_fd, (sockaddr*)&addr, &len) < 0)
+    {
+        perror("listen");
+        return 1;
+    }
+
+    iom.schedulerLock([listen_fd, coro, &iom]()
+    {
+        while(true)
+        {
+            //hook后的accept，返回的fd已经是非阻塞的
+            int fd = accept(listen_fd, nullptr, nullptr);
+            if(fd < 0)
+            {
+                continue;
+            }
+            if(coro)
+            {
+                john::spawn(&iom, coro_echo(fd));
+            }
+            else
+            {
+                iom.schedulerLock([fd]() {fiber_echo(fd);});
+            }
+        }
+    });
+    usleep(100 * 1000);
+
+    long rss0 = bench_proc_kb("VmRSS");
+    long vm0 = bench_proc_kb("VmSize");
+    std::vector<int> clients;
+    clients.reserve(conns);
+    for(long i = 0; i < conns; ++i)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        char c = 'x';
+        if(fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0
+           || write(fd, &c, 1) != 1 || read(fd, &c, 1) != 1)
+        {
+            perror("client");
+            return 1;
+        }
+        clients.push_back(fd);
+    }
+    long rss1 = bench_proc_kb("VmRSS");
+    long vm1 = bench_proc_kb("VmSize");
+
+    printf("%-6s %ld idle connections: VmRSS +%ld KB (%.1f KB/conn), VmSize +%ld KB (%.1f KB/conn)\n",
+           coro ? "coro" : "fiber", conns, rss1 - rss0, (double)(rss1 - rss0) / conns,
+           vm1 - vm0, (double)(vm1 - vm0) / conns);
+    fflush(stdout);
+    //accept协程一直挂起，调度器无法正常stop
+    _exit(0);
+}
+
+int main(int argc, char** argv)
+{
+    long want = argc > 1 ? atol(argv[1]) : 5000;
+    rlim_t limit = bench_raise_nofile(2 * want + 64);
+    long conns = std::min<long>(want, ((long)limit - 64) / 2);
+
+    for(bool coro : {false, true})
+    {
+        pid_t pid = fork();
+        if(pid == 0)
+        {
+            return run(coro, conns);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
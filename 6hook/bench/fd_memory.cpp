@@ -0,0 +1,64 @@
+#include "../ioscheduler.h"
+#include "bench.h"
+#include <unistd.h>
+#include <sys/socket.h>
+
+/*每个空闲连接在IOManager中占用的内存。
+创建N个socket，每个都用addEvent登记一个READ回调后保持空闲，
+比较登记前后的VmRSS，得到每个fd的FdContext、等待节点和回调的总开销。
+socket本身的内核内存不计入RSS。
+
+编译(在6hook目录下)：
+g++ -O2 -std=c++17 bench/fd_memory.cpp $(ls *.cpp | grep -v test.cpp) -o fd_memory -ldl -lpthread
+运行：./fd_memory [连接数=18000]，连接数受RLIMIT_NOFILE限制*/
+
+int main(int argc, char** argv)
+{
+    long want = argc > 1 ? atol(argv[1]) : 18000;
+    rlim_t limit = bench_raise_nofile(want + 64);
+    long conns = std::min<long>(want, (long)limit - 64) & ~1L;
+
+    john::IOManager iom(1, true, "fd_memory");
+
+    std::vector<int> fds;
+    fds.reserve(conns);
+    for(long i = 0; i < conns; i += 2)
+    {
+        int sv[2];
+        if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+        {
+            perror("socketpair");
+            return 1;
+        }
+        fds.push_back(sv[0]);
+        fds.push_back(sv[1]);
+    }
+
+    long rss0 = bench_proc_kb("VmRSS");
+    int registered = 0;
+    for(int fd : fds)
+    {
+        if(iom.addEvent(fd, john::IOManager::READ, [fd]() {printf("fd %d should stay idle\n", fd);}) == 0)
+        {
+            ++registered;
+        }
+    }
+    long rss1 = bench_proc_kb("VmRSS");
+
+    //先全部撤销再关闭，否则关闭一端会让另一端可读并触发回调
+    for(int fd : fds)
+    {
+        iom.delEvent(fd, john::IOManager::READ);
+    }
+
+    printf("%d idle connections registered\n", registered);
+    printf("VmRSS %ld KB -> %ld KB, %.1f bytes per idle connection\n",
+           rss0, rss1, (double)(rss1 - rss0) * 1024 / registered);
+
+    for(int fd : fds)
+    {
+        close(fd);
+    }
+    iom.stop();
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include "../ioscheduler.h"
+#include "../hook.h"
+#include "bench.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <thread>
+#include <atomic>
+#include <string>
+
+/*通过本地TCP连接传输一个大文件的吞吐量(默认1GB)。
+  read + write          文件读到用户态缓冲区再写入socket
+  sendfile              hook后的sendfile，内核内直接从页缓存发送
+  read + send_zerocopy  文件读到用户态缓冲区后用MSG_ZEROCOPY发送，等完成通知后再复用缓冲区
+发送和接收都是同一个worker上的协程，文件事先写好，位于页缓存中。
+回环网卡上MSG_ZEROCOPY仍然会复制数据，还多了一次完成通知的往返，真实网卡上才能看到收益。
+
+编译(在6hook目录下)：
+g++ -O2 -std=c++17 bench/file_transfer.cpp $(ls *.cpp | grep -v test.cpp) -o file_transfer -ldl -lpthread
+运行：./file_transfer [文件大小MB=1024] [文件目录=/tmp]*/
+
+static const size_t CHUNK = 1 << 20;
+
+enum Mode {READ_WRITE, SENDFILE, ZEROCOPY};
+
+static void run(const char* name, Mode mode, const std::string& path, size_t total)
+{
+    std::atomic<size_t> received{0};
+    uint64_t start = 0, end = 0;
+    {
+        //1个worker线程，主线程在stop()时加入
+        john::IOManager iom(2, true, name, true);
+        iom.schedulerLock([&]()
+        {
+            int lfd = socket(AF_INET, SOCK_STREAM, 0);
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t len = sizeof(addr);
+            bind(lfd, (struct sockaddr*)&addr, len);
+            listen(lfd, 1);
+            getsockname(lfd, (struct sockaddr*)&addr, &len);
+
+            //接收端只计数，不做处理
+            john::IOManager::getThis()->schedulerLock([lfd, &received, &end]()
+            {
+                int fd = accept(lfd, nullptr, nullptr);
+                std::vector<char> buf(CHUNK);
+                ssize_t n;
+                while((n = read(fd, buf.data(), buf.size())) > 0)
+                {
+                    received += n;
+                }
+                end = bench_now_ns();
+                close(fd);
+                close(lfd);
+            });
+
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+            {
+                perror("connect");
+                exit(1);
+            }
+            int file = open(path.c_str(), O_RDONLY);
+            std::vector<char> buf(CHUNK);
+            start = bench_now_ns();
+            size_t sent = 0;
+            while(sent < total)
+            {
+                ssize_t n;
+                if(mode == SENDFILE)
+                {
+                    n = sendfile(fd, file, nullptr, CHUNK);
+                }
+                else
+                {
+                    n = read(file, buf.data(), CHUNK);
+                    if(n <= 0)
+                    {
+                        break;
+                    }
+                    n = mode == ZEROCOPY ? john::send_zerocopy(fd, buf.data(), n) : write(fd, buf.data(), n);
+                }
+                if(n <= 0)
+                {
+                    perror(name);
+                    break;
+                }
+                sent += n;
+            }
+            close(file);
+            close(fd);
+        });
+        iom.stop();
+    }
+    double secs = (end - start) / 1e9;
+    printf("%-22s %6zu MB in %6.3f s  %7.0f MB/s\n", name, received.load() >> 20, secs, (received >> 20) / secs);
+}
+
+int main(int argc, char** argv)
+{
+    size_t mb = argc > 1 ? atol(argv[1]) : 1024;
+    std::string dir = argc > 2 ? argv[2] : "/tmp";
+    std::string path = dir + "/file_transfer." + std::to_string(getpid());
+    size_t total = mb << 20;
+
+    //先写好文件，之后三种方式都从页缓存读取
+    int file = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(file < 0)
+    {
+        perror("open");
+        return 1;
+    }
+    std::vector<char> buf(CHUNK, 'f');
+    for(size_t done = 0; done < total; done += CHUNK)
+    {
+        write(file, buf.data(), CHUNK);
+    }
+    close(file);
+
+    printf("%u CPUs, 1 worker, %zu MB file over loopback TCP\n", std::thread::hardware_concurrency(), mb);
+    run("read + write", READ_WRITE, path, total);
+    run("sendfile", SENDFILE, path, total);
+    run("read + send_zerocopy", ZEROCOPY, path, total);
+    unlink(path.c_str());
+    return 0;
+}
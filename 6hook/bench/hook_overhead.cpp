@@ -0,0 +1,77 @@
+#include "../hook.h"
+#include "../fd_manager.h"
+#include "bench.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <thread>
+#include <atomic>
+
+/*hook快速路径的开销：1/8/32个线程同时调用时每次调用的纳秒数。
+  FdMgr::get      只做单例获取和FdCtx查找
+  fcntl_f         原始fcntl(F_GETFL)
+  hooked fcntl    hook后的fcntl(F_GETFL)，每次都经过FdMgr::GetInstance()
+
+编译(在6hook目录下)：
+g++ -O2 -std=c++17 bench/hook_overhead.cpp $(ls *.cpp | grep -v test.cpp) -o hook_overhead -ldl -lpthread
+运行：./hook_overhead [每种情况的总调用次数=4000000]*/
+
+static int g_fd = -1;
+
+template<typename Fun>
+static double run(int threads, long total, Fun fun)
+{
+    long per_thread = total / threads;
+    std::atomic<bool> go{false};
+    std::vector<std::thread> ts;
+    for(int i = 0; i < threads; ++i)
+    {
+        ts.emplace_back([&]()
+        {
+            john::set_hook_enable(true);
+            while(!go)
+            {
+                std::this_thread::yield();
+            }
+            for(long k = 0; k < per_thread; ++k)
+            {
+                fun();
+            }
+        });
+    }
+    uint64_t start = bench_now_ns();
+    go = true;
+    for(auto& t : ts)
+    {
+        t.join();
+    }
+    return (double)(bench_now_ns() - start) / (per_thread * threads);
+}
+
+int main(int argc, char** argv)
+{
+    long total = argc > 1 ? atol(argv[1]) : 4000000;
+
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    john::FdMgr::GetInstance()->get(sv[0], true);
+    g_fd = sv[0];
+
+    printf("%u CPUs, %ld calls per case\n", std::thread::hardware_concurrency(), total);
+    printf("%-8s %14s %14s %14s\n", "threads", "FdMgr::get", "fcntl_f", "hooked fcntl");
+    for(int n : {1, 8, 32})
+    {
+        double lookup = run(n, total, []()
+        {
+            std::shared_ptr<john::FdCtx> ctx = john::FdMgr::GetInstance()->get(g_fd);
+            asm volatile("" : : "r"(ctx.get()) : "memory");
+        });
+        double raw = run(n, total, []() {fcntl_f(g_fd, F_GETFL);});
+        double hooked = run(n, total, []() {fcntl(g_fd, F_GETFL);});
+        printf("%-8d %11.1f ns %11.1f ns %11.1f ns\n", n, lookup, raw, hooked);
+    }
+
+    close(sv[0]);
+    close(sv[1]);
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include "../hook.h"
+#include "../fd_manager.h"
+#include "bench.h"
+#include <unistd.h>
+#include <sys/socket.h>
+#include <thread>
+
+/*socketpair上单字节read的开销：原始read_f、hook关闭时的read、hook开启时的read。
+每次先写入1字节再读出，数据总是就绪，hook开启时也不会挂起，测的只是调用路径本身。
+用 -DJOHN_NO_HOOK 编译时libc同名函数不再被hook，"hooked"两行就是直接调用libc。
+
+编译(在6hook目录下)：
+g++ -O2 -std=c++17 bench/hook_read.cpp $(ls *.cpp | grep -v test.cpp) -o hook_read -ldl -lpthread
+运行：./hook_read [每种情况的次数=1000000]*/
+
+static double run(int sv[2], bool raw, long iters)
+{
+    char c = 'x', b;
+    uint64_t start = bench_now_ns();
+    for(long i = 0; i < iters; ++i)
+    {
+        write_f(sv[1], &c, 1);
+        if(raw)
+        {
+            read_f(sv[0], &b, 1);
+        }
+        else
+        {
+            read(sv[0], &b, 1);
+        }
+    }
+    return (double)(bench_now_ns() - start) / iters;
+}
+
+int main(int argc, char** argv)
+{
+    long iters = argc > 1 ? atol(argv[1]) : 1000000;
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    john::FdMgr::GetInstance()->get(sv[0], true);
+    john::FdMgr::GetInstance()->get(sv[1], true);
+
+    printf("%u CPUs, %ld write+read pairs per case\n", std::thread::hardware_concurrency(), iters);
+    //交替跑三轮，看清运行间的波动
+    for(int round = 0; round < 3; ++round)
+    {
+        double raw = run(sv, true, iters);
+        john::set_hook_enable(false);
+        double disabled = run(sv, false, iters);
+        john::set_hook_enable(true);
+        double enabled = run(sv, false, iters);
+        john::set_hook_enable(false);
+        printf("raw read_f %7.1f ns   hooked, disabled %7.1f ns   hooked, enabled %7.1f ns\n", raw, disabled, enabled);
+    }
+    close(sv[0]);
+    close(sv[1]);
+    return 0;
+}
@@ -0,0 +1,160 @@
+#include "../ioscheduler.h"
+#include "../hook.h"
+#include "bench.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <thread>
+#include <atomic>
+#include <string>
+
+/*磁盘IO和网络IO混合时网络请求的延迟。
+回显服务端是worker上用hook后的阻塞读写处理一个本地TCP连接的协程，
+客户端是一个普通线程，按每200us一个的计划发请求，延迟从计划发送时间算到收到回复，
+服务端卡住期间本该发出的请求都会计入延迟；
+同时若干磁盘协程不断对各自的文件做64KB的pwrite/pread，每16次写做一次fsync。
+磁盘协程不会主动让出，普通文件IO如果直接在worker上执行，回显协程就要排在它们后面。
+磁盘协程最多运行DISK_LIMIT_S秒，防止回显协程一直得不到调度时测试停不下来。
+
+编译(在6hook目录下)：
+g++ -O2 -std=c++17 bench/mixed_io.cpp $(ls *.cpp | grep -v test.cpp) -o mixed_io -ldl -lpthread
+运行：./mixed_io [样本数=5000] [磁盘协程数=4] [文件目录=/tmp]*/
+
+static const int DISK_LIMIT_S = 10;
+static const int INTERVAL_US = 200;
+static const size_t BLOCK = 64 * 1024;
+static const off_t FILE_SPAN = 64 * 1024 * 1024;
+
+static void disk_loop(const std::string& path, std::atomic<bool>& stop, std::atomic<long>& ops)
+{
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+        perror("open");
+        return;
+    }
+    std::vector<char> buf(BLOCK, 'd');
+    uint64_t end = bench_now_ns() + DISK_LIMIT_S * 1000000000ULL;
+    unsigned seed = (unsigned)fd;
+    for(long n = 1; !stop && bench_now_ns() < end; ++n)
+    {
+        off_t off = (off_t)(rand_r(&seed) % (FILE_SPAN / BLOCK)) * BLOCK;
+        pwrite(fd, buf.data(), BLOCK, off);
+        pread(fd, buf.data(), BLOCK, off);
+        if(n % 16 == 0)
+        {
+            fsync(fd);
+        }
+        ++ops;
+    }
+    close(fd);
+    unlink(path.c_str());
+}
+
+static void run(const char* name, int samples, int disk_fibers, const std::string& dir)
+{
+    BenchLatency lat;
+    std::atomic<bool> stop{false};
+    std::atomic<long> ops{0};
+    uint64_t start = bench_now_ns();
+    {
+        //2个worker线程，主线程在stop()时加入
+        john::IOManager iom(3, true, name, true);
+
+        //监听socket和accept得到的连接都由hook创建，登记在FdMgr中，回显协程在它们上面挂起等待
+        std::atomic<int> port{0};
+        iom.schedulerLock([&port]()
+        {
+            int lfd = socket(AF_INET, SOCK_STREAM, 0);
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t len = sizeof(addr);
+            bind(lfd, (struct sockaddr*)&addr, len);
+            listen(lfd, 1);
+            getsockname(lfd, (struct sockaddr*)&addr, &len);
+            port = ntohs(addr.sin_port);
+
+            int fd = accept(lfd, nullptr, nullptr);
+            close(lfd);
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            uint64_t ts;
+            while(read(fd, &ts, sizeof(ts)) == sizeof(ts))
+            {
+                write(fd, &ts, sizeof(ts));
+            }
+            close(fd);
+        });
+        for(int i = 0; i < disk_fibers; ++i)
+        {
+            std::string path = dir + "/mixed_io." + std::to_string(getpid()) + "." + std::to_string(i);
+            iom.schedulerLock([path, &stop, &ops]() {disk_loop(path, stop, ops);});
+        }
+
+        std::thread client([&]()
+        {
+            while(port == 0)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            //客户端线程没有开启hook，用的是普通的阻塞socket
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+            {
+                perror("connect");
+                exit(1);
+            }
+            //按固定节奏计划发送时间，延迟从计划时间算起，服务端卡住期间本该发出的请求都计入延迟
+            uint64_t begin = bench_now_ns();
+            for(int i = 0; i < samples; ++i)
+            {
+                uint64_t target = begin + (uint64_t)(i + 1) * INTERVAL_US * 1000;
+                uint64_t now = bench_now_ns();
+                if(now < target)
+                {
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(target - now));
+                }
+                uint64_t ts = bench_now_ns();
+                if(write(fd, &ts, sizeof(ts)) != sizeof(ts) || read(fd, &ts, sizeof(ts)) != sizeof(ts))
+                {
+                    break;
+                }
+                lat.add((bench_now_ns() - std::min(target, ts)) / 1000.0);
+            }
+            stop = true;
+            close(fd);
+        });
+        client.join();
+        iom.stop();
+    }
+    double secs = (bench_now_ns() - start) / 1e9;
+    lat.print(name);
+    if(disk_fibers > 0)
+    {
+        printf("%-24s %ld disk ops (64KB write + read) in %.2f s, %.0f ops/s\n", "", ops.load(), secs, ops / secs);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    setvbuf(stdout, nullptr, _IONBF, 0);
+    int samples = argc > 1 ? atoi(argv[1]) : 5000;
+    int disk_fibers = argc > 2 ? atoi(argv[2]) : 4;
+    std::string dir = argc > 3 ? argv[3] : "/tmp";
+    printf("%u CPUs, 2 workers, %d ping-pongs every %d us\n", std::thread::hardware_concurrency(), samples, INTERVAL_US);
+    run("network only", samples, 0, dir);
+    run("network + disk", samples, disk_fibers, dir);
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include "../ioscheduler.h"
+#include "../fiber_sync.h"
+#include "../hook.h"
+#include "bench.h"
+#include <unistd.h>
+#include <mutex>
+#include <thread>
+
+/*10000个协程在8个worker上争用同一把锁，FiberMutex对比std::mutex。
+  短临界区     每个协程加锁、计数、解锁100次，比较每次加解锁的平均耗时
+  让出的临界区 持有FiberMutex时调用hook后的usleep(10)，只有FiberMutex能这样用：
+               持有std::mutex让出后，同一线程上的其他协程再加锁就会卡住整个worker
+
+编译(在6hook目录下)：
+g++ -O2 -std=c++17 bench/mutex_contention.cpp $(ls *.cpp | grep -v test.cpp) -o mutex_contention -ldl -lpthread
+运行：./mutex_contention [协程数=10000] [每个协程加锁次数=100]*/
+
+template<typename Mutex>
+static void short_section(const char* name, int fibers, int ops)
+{
+    Mutex m;
+    long counter = 0;
+    uint64_t start = bench_now_ns();
+    {
+        //8个worker线程，主线程在stop()时加入
+        john::IOManager iom(9, true, name);
+        for(int i = 0; i < fibers; ++i)
+        {
+            iom.schedulerLock([&m, &counter, ops]()
+            {
+                for(int k = 0; k < ops; ++k)
+                {
+                    std::lock_guard<Mutex> lock(m);
+                    ++counter;
+                }
+            });
+        }
+        iom.stop();
+    }
+    double ns = (double)(bench_now_ns() - start) / ((long)fibers * ops);
+    printf("%-12s short section   counter=%ld (%s)  %6.1f ns/op\n", name, counter,
+           counter == (long)fibers * ops ? "ok" : "WRONG", ns);
+}
+
+static void yielding_section(int fibers)
+{
+    john::FiberMutex m;
+    long counter = 0;
+    uint64_t start = bench_now_ns();
+    {
+        john::IOManager iom(9, true, "yield", true);
+        for(int i = 0; i < fibers; ++i)
+        {
+            iom.schedulerLock([&m, &counter]()
+            {
+                std::lock_guard<john::FiberMutex> lock(m);
+                ++counter;
+                usleep(10);
+            });
+        }
+        iom.stop();
+    }
+    printf("%-12s yielding section counter=%ld (%s)  %6.1f ms total\n", "FiberMutex", counter,
+           counter == fibers ? "ok" : "WRONG", (bench_now_ns() - start) / 1e6);
+}
+
+int main(int argc, char** argv)
+{
+    int fibers = argc > 1 ? atoi(argv[1]) : 10000;
+    int ops = argc > 2 ? atoi(argv[2]) : 100;
+    printf("%u CPUs, 8 workers, %d fibers x %d lock/unlock\n", std::thread::hardware_concurrency(), fibers, ops);
+    for(int round = 0; round < 3; ++round)
+    {
+        short_section<std::mutex>("std::mutex", fibers, ops);
+        short_section<john::FiberMutex>("FiberMutex", fibers, ops);
+    }
+    yielding_section(fibers / 5);
+    return 0;
+}
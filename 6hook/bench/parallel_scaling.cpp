@@ -0,0 +1,122 @@
+#include "../ioscheduler.h"
+#include "../future.h"
+#include "../parallel.h"
+#include "bench.h"
+#include <cmath>
+#include <random>
+#include <thread>
+#ifdef BENCH_STD_PAR
+#include <execution>
+#endif
+
+/*parallel_sort、parallel_reduce、parallel_for在1/2/4/8个调度线程上的耗时，对比单线程的std::sort和顺序循环。
+  sort    N个随机double排序，结果与std::sort逐个比较
+  reduce  对每个元素求sqrt后累加，与顺序求和的相对误差应在1e-12以内
+  for     out[i] = in[i] * 2
+调用方是调度器中的协程，join时挂起协程而不占用worker。
+定义BENCH_STD_PAR时再测std::execution::par（libstdc++由TBB实现，需要-ltbb），线程数由TBB决定。
+
+编译(在6hook目录下)：
+g++ -O2 -std=c++17 bench/parallel_scaling.cpp $(ls *.cpp | grep -v test.cpp) -o parallel_scaling -ldl -lpthread
+g++ -O2 -std=c++17 -DBENCH_STD_PAR bench/parallel_scaling.cpp $(ls *.cpp | grep -v test.cpp) -o parallel_scaling -ldl -lpthread -ltbb
+运行：./parallel_scaling [元素个数=4000000]*/
+
+static double seconds_since(uint64_t start)
+{
+    return (bench_now_ns() - start) / 1e9;
+}
+
+int main(int argc, char** argv)
+{
+    size_t n = argc > 1 ? (size_t)atol(argv[1]) : 4000000;
+    std::vector<double> input(n);
+    std::mt19937_64 rng(1);
+    for(auto& x : input)
+    {
+        x = rng() % 1000000;
+    }
+
+    //单线程基准
+    std::vector<double> sorted = input;
+    uint64_t start = bench_now_ns();
+    std::sort(sorted.begin(), sorted.end());
+    double t_sort = seconds_since(start);
+
+    start = bench_now_ns();
+    double sum = 0;
+    for(size_t i = 0; i < n; ++i)
+    {
+        sum += std::sqrt(input[i]);
+    }
+    double t_reduce = seconds_since(start);
+
+    std::vector<double> doubled(n);
+    start = bench_now_ns();
+    for(size_t i = 0; i < n; ++i)
+    {
+        doubled[i] = input[i] * 2;
+    }
+    double t_for = seconds_since(start);
+
+    printf("%u CPUs, %zu doubles\n", std::thread::hardware_concurrency(), n);
+    printf("%-22s sort %6.3f s   reduce %6.3f s   for %6.3f s\n", "sequential", t_sort, t_reduce, t_for);
+
+#ifdef BENCH_STD_PAR
+    {
+        std::vector<double> a = input;
+        start = bench_now_ns();
+        std::sort(std::execution::par, a.begin(), a.end());
+        double ts = seconds_since(start);
+        start = bench_now_ns();
+        double s = std::transform_reduce(std::execution::par, input.begin(), input.end(), 0.0,
+                                         std::plus<double>(), [](double x) {return std::sqrt(x);});
+        double tr = seconds_since(start);
+        std::vector<double> out(n);
+        start = bench_now_ns();
+        std::transform(std::execution::par, input.begin(), input.end(), out.begin(), [](double x) {return x * 2;});
+        double tf = seconds_since(start);
+        bool ok = a == sorted && std::fabs(s - sum) / sum < 1e-12 && out == doubled;
+        printf("%-22s sort %6.3f s   reduce %6.3f s   for %6.3f s   %s\n", "std::execution::par",
+               ts, tr, tf, ok ? "ok" : "WRONG");
+    }
+#endif
+
+    for(int workers : {1, 2, 4, 8})
+    {
+        std::vector<double> a = input;
+        std::vector<double> out(n);
+        double ts = 0, tr = 0, tf = 0, s = 0;
+        {
+            //workers-1个worker线程，主线程在stop()时加入，一共workers个线程
+            john::IOManager iom(workers, true, "parallel");
+            john::Future<void> f = john::submit(&iom, [&]()
+            {
+                uint64_t t = bench_now_ns();
+                john::parallel_sort(&iom, a.begin(), a.end());
+                ts = seconds_since(t);
+
+                t = bench_now_ns();
+                s = john::parallel_reduce(&iom, 0, n, 0.0, [&input](size_t b, size_t e, double acc)
+                {
+                    for(size_t i = b; i < e; ++i)
+                    {
+                        acc += std::sqrt(input[i]);
+                    }
+                    return acc;
+                }, [](double x, double y) {return x + y;});
+                tr = seconds_since(t);
+
+                t = bench_now_ns();
+                john::parallel_for(&iom, 0, n, [&input, &out](size_t i) {out[i] = input[i] * 2;});
+                tf = seconds_since(t);
+            });
+            iom.stop();
+            f.get();
+        }
+        bool ok = a == sorted && std::fabs(s - sum) / sum < 1e-12 && out == doubled;
+        char name[32];
+        snprintf(name, sizeof(name), "john %d workers", workers);
+        printf("%-22s sort %6.3f s   reduce %6.3f s   for %6.3f s   %s\n", name, ts, tr, tf, ok ? "ok" : "WRONG");
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include "../ioscheduler.h"
+#include "../hook.h"
+#include "bench.h"
+#include <unistd.h>
+#include <sys/socket.h>
+#include <thread>
+#include <atomic>
+
+/*IOManager各轮询策略下的唤醒延迟(wake-to-resume)。
+一个普通线程按固定间隔往socketpair写入当前时间戳，worker上的协程阻塞在hook后的read上，
+醒来后用当前时间减去时间戳，得到从数据写入到协程恢复执行的延迟。
+
+编译(在6hook目录下)：
+g++ -O2 -std=c++17 bench/poll_latency.cpp $(ls *.cpp | grep -v test.cpp) -o poll_latency -ldl -lpthread
+运行：./poll_latency [每种策略的样本数=20000] [写入间隔us=100]*/
+
+static void run(const char* name, john::IOManager::PollPolicy policy, int samples, int interval_us)
+{
+    BenchLatency lat;
+    {
+        //1个worker线程，主线程在stop()时加入
+        john::IOManager iom(2, true, name, true);
+        iom.setPollPolicy(policy, 50);
+
+        std::atomic<int> wfd{-1};
+        iom.schedulerLock([&]()
+        {
+            //socketpair在hook开启的协程里创建，才会登记到FdMgr并设为非阻塞
+            int sv[2];
+            socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+            wfd = sv[1];
+            for(int i = 0; i < samples; ++i)
+            {
+                uint64_t ts;
+                if(read(sv[0], &ts, sizeof(ts)) != sizeof(ts))
+                {
+                    break;
+                }
+                lat.add((bench_now_ns() - ts) / 1000.0);
+            }
+            close(sv[0]);
+        });
+
+        std::thread writer([&]()
+        {
+            while(wfd < 0)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            for(int i = 0; i < samples; ++i)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(interval_us));
+                uint64_t ts = bench_now_ns();
+                write(wfd, &ts, sizeof(ts));
+            }
+        });
+        writer.join();
+        //read协程收完所有样本后stop()才会返回
+        iom.stop();
+        close(wfd);
+    }
+    lat.print(name);
+}
+
+int main(int argc, char** argv)
+{
+    int samples = argc > 1 ? atoi(argv[1]) : 20000;
+    int interval_us = argc > 2 ? atoi(argv[2]) : 100;
+    printf("%u CPUs, %d samples per policy, one write every %d us\n",
+           std::thread::hardware_concurrency(), samples, interval_us);
+    run("BLOCK", john::IOManager::BLOCK, samples, interval_us);
+    run("SPIN_THEN_BLOCK(50us)", john::IOManager::SPIN_THEN_BLOCK, samples, interval_us);
+    run("BUSY_POLL", john::IOManager::BUSY_POLL, samples, interval_us);
+    return 0;
+}
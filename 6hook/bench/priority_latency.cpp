@@ -0,0 +1,118 @@
+#include "../ioscheduler.h"
+#include "bench.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+/*任务优先级类别对前台任务排队延迟的影响，1个worker线程。
+  后台负载  每20ms投递150个100us的忙等任务，大约占满worker的75%
+  前台任务  每2ms投递一个20us的忙等任务，记录从投递到开始执行的排队延迟
+三种配置：FIFO（前后台都是NORMAL，同一个队列）、STRICT（前台HIGH、后台LOW）、WEIGHTED（权重8/4/1）。
+最后检查饿死保护：HIGH任务不断重新投递自己，看500ms内50个LOW任务能执行多少个，starvation_limit分别为0和64。
+
+编译(在6hook目录下)：
+g++ -O2 -std=c++17 bench/priority_latency.cpp $(ls *.cpp | grep -v test.cpp) -o priority_latency -ldl -lpthread
+运行：./priority_latency [前台任务数=1000]*/
+
+static void busy_us(uint64_t us)
+{
+    uint64_t end = bench_now_ns() + us * 1000;
+    while(bench_now_ns() < end);
+}
+
+static void foreground(const char* name, john::Scheduler::PriorityPolicy policy, int fg, int bg, int count)
+{
+    BenchLatency lat;
+    std::mutex mutex;
+    std::atomic<long> bg_done{0};
+    std::atomic<bool> stop{false};
+    {
+        //1个worker线程，主线程只投递任务，到析构时的stop()才加入调度
+        john::IOManager iom(2, true, name);
+        iom.setPriorityPolicy(policy);
+
+        std::thread loader([&]()
+        {
+            while(!stop)
+            {
+                for(int i = 0; i < 150; ++i)
+                {
+                    iom.schedulerLock(std::function<void()>([&bg_done]()
+                    {
+                        busy_us(100);
+                        ++bg_done;
+                    }), -1, bg);
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        for(int i = 0; i < count; ++i)
+        {
+            uint64_t posted = bench_now_ns();
+            iom.schedulerLock(std::function<void()>([&lat, &mutex, posted]()
+            {
+                double us = (bench_now_ns() - posted) / 1e3;
+                busy_us(20);
+                std::lock_guard<std::mutex> lock(mutex);
+                lat.add(us);
+            }), -1, fg);
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        stop = true;
+        loader.join();
+    }
+    lat.print(name);
+    printf("%-24s background tasks done: %ld\n", "", bg_done.load());
+}
+
+static void starvation(uint32_t limit)
+{
+    std::atomic<long> high{0}, low{0};
+    std::atomic<bool> stop{false};
+    {
+        john::IOManager iom(2, true, "starvation");
+        iom.setPriorityPolicy(john::Scheduler::STRICT, limit);
+        for(int i = 0; i < 50; ++i)
+        {
+            iom.schedulerLock(std::function<void()>([&low]()
+            {
+                busy_us(50);
+                ++low;
+            }), -1, john::Scheduler::PRIORITY_LOW);
+        }
+        //每个HIGH任务结束前重新投递自己，HIGH队列一直不空
+        std::function<void()> flood = [&]()
+        {
+            busy_us(50);
+            ++high;
+            if(!stop)
+            {
+                iom.schedulerLock(flood, -1, john::Scheduler::PRIORITY_HIGH);
+            }
+        };
+        for(int i = 0; i < 8; ++i)
+        {
+            iom.schedulerLock(flood, -1, john::Scheduler::PRIORITY_HIGH);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        printf("starvation_limit=%-3u 500ms HIGH flood: high=%ld low=%ld/50\n", limit, high.load(), low.load());
+        stop = true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 1000;
+    printf("%u CPUs, 1 worker; foreground queue delay under background load\n", std::thread::hardware_concurrency());
+    foreground("FIFO (all NORMAL)", john::Scheduler::STRICT,
+               john::Scheduler::PRIORITY_NORMAL, john::Scheduler::PRIORITY_NORMAL, count);
+    foreground("STRICT HIGH/LOW", john::Scheduler::STRICT,
+               john::Scheduler::PRIORITY_HIGH, john::Scheduler::PRIORITY_LOW, count);
+    foreground("WEIGHTED 8/4/1", john::Scheduler::WEIGHTED,
+               john::Scheduler::PRIORITY_HIGH, john::Scheduler::PRIORITY_LOW, count);
+    starvation(0);
+    starvation(64);
+    return 0;
+}
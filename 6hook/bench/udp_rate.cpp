@@ -0,0 +1,169 @@
+#include "../ioscheduler.h"
+#include "../hook.h"
+#include "bench.h"
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+#include <thread>
+#include <atomic>
+
+/*本地回环上的UDP包速率，64字节的包，每批64个。
+  send / recv            每个包一次系统调用，接收端每个包唤醒一次
+  sendmmsg / recvmmsg    send_batch批量发送，hook后的recvmmsg一次取走所有已到达的包
+  UDP_SEGMENT / recvmmsg 发送端用GSO一次发出64个包，接收端仍按包接收
+  UDP_SEGMENT / UDP_GRO  接收端开启GRO，一次recvmsg收到合并后的多个包
+发送和接收是同一个worker上的协程，发送端每发一批让出一次，让接收端取走数据，避免接收缓冲区溢出丢包。
+
+编译(在6hook目录下)：
+g++ -O2 -std=c++17 bench/udp_rate.cpp $(ls *.cpp | grep -v test.cpp) -o udp_rate -ldl -lpthread
+运行：./udp_rate [包数=1000000]*/
+
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+static const int PKT = 64;
+static const int BATCH = 64;
+
+enum Mode {PER_PACKET, MMSG, GSO, GSO_GRO};
+
+static void run(const char* name, Mode mode, long packets)
+{
+    long got = 0, calls = 0;
+    uint64_t start = 0, last = 0;
+    {
+        //1个worker线程，主线程在stop()时加入
+        john::IOManager iom(2, true, name, true);
+        iom.schedulerLock([&]()
+        {
+            int r = socket(AF_INET, SOCK_DGRAM, 0);
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t len = sizeof(addr);
+            bind(r, (struct sockaddr*)&addr, len);
+            getsockname(r, (struct sockaddr*)&addr, &len);
+            int rcvbuf = 8 << 20;
+            setsockopt(r, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+            //发送结束后200ms收不到包就认为结束
+            struct timeval tv = {0, 200000};
+            setsockopt(r, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            if(mode == GSO_GRO && john::set_udp_gro(r, true) < 0)
+            {
+                perror("UDP_GRO");
+            }
+
+            int s = socket(AF_INET, SOCK_DGRAM, 0);
+            connect(s, (struct sockaddr*)&addr, sizeof(addr));
+            if((mode == GSO || mode == GSO_GRO) && john::set_udp_segment(s, PKT) < 0)
+            {
+                perror("UDP_SEGMENT");
+            }
+
+            john::IOManager::getThis()->schedulerLock([s, mode, packets]()
+            {
+                static char buf[PKT * BATCH];
+                struct mmsghdr msgs[BATCH];
+                struct iovec iov[BATCH];
+                for(int i = 0; i < BATCH; ++i)
+                {
+                    iov[i].iov_base = buf + i * PKT;
+                    iov[i].iov_len = PKT;
+                    memset(&msgs[i], 0, sizeof(msgs[i]));
+                    msgs[i].msg_hdr.msg_iov = &iov[i];
+                    msgs[i].msg_hdr.msg_iovlen = 1;
+                }
+                for(long sent = 0; sent < packets; sent += BATCH)
+                {
+                    if(mode == PER_PACKET)
+                    {
+                        for(int i = 0; i < BATCH; ++i)
+                        {
+                            send(s, buf, PKT, 0);
+                        }
+                    }
+                    else if(mode == MMSG)
+                    {
+                        john::send_batch(s, msgs, BATCH);
+                    }
+                    else
+                    {
+                        send(s, buf, sizeof(buf), 0);
+                    }
+                    usleep(0);
+                }
+                close(s);
+            });
+
+            static char rbuf[BATCH][PKT * BATCH];
+            struct mmsghdr msgs[BATCH];
+            struct iovec iov[BATCH];
+            char control[CMSG_SPACE(sizeof(int))];
+            for(int i = 0; i < BATCH; ++i)
+            {
+                iov[i].iov_base = rbuf[i];
+                iov[i].iov_len = mode == GSO_GRO ? sizeof(rbuf[i]) : PKT;
+                memset(&msgs[i], 0, sizeof(msgs[i]));
+                msgs[i].msg_hdr.msg_iov = &iov[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+            msgs[0].msg_hdr.msg_control = control;
+
+            start = bench_now_ns();
+            while(true)
+            {
+                long n;
+                if(mode == PER_PACKET)
+                {
+                    n = recv(r, rbuf[0], PKT, 0) > 0 ? 1 : -1;
+                }
+                else if(mode == GSO_GRO)
+                {
+                    //合并后的包由cmsg给出分段大小，没有cmsg时是单个包
+                    msgs[0].msg_hdr.msg_controllen = sizeof(control);
+                    ssize_t bytes = recvmsg(r, &msgs[0].msg_hdr, 0);
+                    n = bytes > 0 ? 1 : -1;
+                    struct cmsghdr* cm = bytes > 0 ? CMSG_FIRSTHDR(&msgs[0].msg_hdr) : nullptr;
+                    if(cm && cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO)
+                    {
+                        int seg;
+                        memcpy(&seg, CMSG_DATA(cm), sizeof(seg));
+                        n = (bytes + seg - 1) / seg;
+                    }
+                }
+                else
+                {
+                    n = recvmmsg(r, msgs, BATCH, 0, nullptr);
+                }
+                if(n <= 0)
+                {
+                    break;
+                }
+                got += n;
+                ++calls;
+                last = bench_now_ns();
+            }
+            close(r);
+        });
+        iom.stop();
+    }
+    double secs = (last - start) / 1e9;
+    printf("%-24s %8ld pkts (%5.1f%% lost) in %8ld receive calls  %6.0f kpps\n",
+           name, got, 100.0 * (packets - got) / packets, calls, got / secs / 1000);
+}
+
+int main(int argc, char** argv)
+{
+    long packets = argc > 1 ? atol(argv[1]) : 1000000;
+    packets -= packets % BATCH;
+    printf("%u CPUs, 1 worker, %ld x %d byte datagrams over loopback\n",
+           std::thread::hardware_concurrency(), packets, PKT);
+    run("send / recv", PER_PACKET, packets);
+    run("sendmmsg / recvmmsg", MMSG, packets);
+    run("UDP_SEGMENT / recvmmsg", GSO, packets);
+    run("UDP_SEGMENT / UDP_GRO", GSO_GRO, packets);
+    return 0;
+}
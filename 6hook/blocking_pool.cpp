@@ -0,0 +1,51 @@
+#include "blocking_pool.h"
+
+namespace john {
+
+BlockingPool::BlockingPool(size_t threads, const std::string& name) {
+    m_threads.resize(threads);
+    for(size_t i = 0; i < threads; ++i) {
+        m_threads[i].reset(new Thread(std::bind(&BlockingPool::run, this), name + "_" + std::to_string(i)));
+    }
+}
+
+BlockingPool::~BlockingPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_cond.notify_all();
+
+    for(auto& t : m_threads) {
+        t->join();
+    }
+}
+
+void BlockingPool::submit(std::function<void()> cb) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(cb));
+    }
+    m_cond.notify_one();
+}
+
+void BlockingPool::run() {
+    while(true) {
+        std::function<void()> cb;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while(m_tasks.empty() && !m_stopping) {
+                m_cond.wait(lock);
+            }
+            //停止时也要把剩余任务执行完，否则挂起的协程永远不会被唤醒
+            if(m_tasks.empty()) {
+                break;
+            }
+            cb.swap(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        cb();
+    }
+}
+
+}
@@ -0,0 +1,42 @@
+#ifndef _BLOCKING_POOL_H_
+#define _BLOCKING_POOL_H_
+
+#include <memory>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include "thread.h"
+#include "fd_manager.h"
+
+namespace john {
+
+//阻塞IO线程池
+//普通文件的read/write等操作无法用epoll等待，直接调用会阻塞整个工作线程。
+//hook把这类操作提交到这里的专用线程上执行，发起调用的协程先挂起，完成后再由调度器恢复。
+class BlockingPool {
+public:
+    BlockingPool(size_t threads = 4, const std::string& name = "BlockingPool");
+    ~BlockingPool();
+
+    //提交一个阻塞任务，由池中的线程执行
+    void submit(std::function<void()> cb);
+
+private:
+    //线程函数，循环取出任务执行
+    void run();
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<std::function<void()>> m_tasks; //待执行的阻塞任务
+    std::vector<std::shared_ptr<Thread>> m_threads;
+    bool m_stopping = false;
+};
+
+typedef Singleton<BlockingPool> BlockingPoolMgr;
+
+}
+
+#endif
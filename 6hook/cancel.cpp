@@ -0,0 +1,95 @@
+#include "cancel.h"
+#include "fiber_local.h"
+#include <algorithm>
+
+namespace john {
+
+static FiberLocal<CancelToken::ptr> t_cancel_token;
+
+CancelToken::ptr CancelToken::create(const ptr& parent, std::chrono::steady_clock::time_point deadline) {
+    ptr token(new CancelToken());
+    token->m_deadline = deadline;
+    if(!parent) {
+        return token;
+    }
+
+    token->m_deadline = std::min(deadline, parent->m_deadline);
+    //回调在父令牌的cancel中执行，此时父令牌一定还活着
+    std::weak_ptr<CancelToken> weak(token);
+    CancelToken* raw_parent = parent.get();
+    uint64_t id = parent->addCallback([weak, raw_parent]() {
+        if(auto t = weak.lock()) {
+            t->cancel(raw_parent->error());
+        }
+    });
+    if(id == 0) {
+        token->cancel(parent->error());
+    } else {
+        token->m_parent = parent;
+        token->m_parentId = id;
+    }
+    return token;
+}
+
+CancelToken::~CancelToken() {
+    if(m_parent) {
+        m_parent->removeCallback(m_parentId);
+    }
+}
+
+void CancelToken::cancel(int error) {
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+    if(m_error.load(std::memory_order_relaxed)) {
+        return;
+    }
+    m_error.store(error, std::memory_order_release);
+
+    //回调执行期间可能撤销其他回调，先换出来再执行；持锁执行保证removeCallback返回后回调不会还在运行
+    std::vector<std::pair<uint64_t, std::function<void()>>> callbacks;
+    callbacks.swap(m_callbacks);
+    for(auto& cb : callbacks) {
+        cb.second();
+    }
+}
+
+uint64_t CancelToken::addCallback(std::function<void()> cb) {
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+    if(m_error.load(std::memory_order_relaxed)) {
+        return 0;
+    }
+    uint64_t id = m_nextId++;
+    m_callbacks.emplace_back(id, std::move(cb));
+    return id;
+}
+
+void CancelToken::removeCallback(uint64_t id) {
+    std::lock_guard<std::recursive_mutex> lock(m_mutex);
+    for(auto it = m_callbacks.begin(); it != m_callbacks.end(); ++it) {
+        if(it->first == id) {
+            m_callbacks.erase(it);
+            return;
+        }
+    }
+}
+
+CancelToken* CancelToken::current() {
+    CancelToken::ptr* token = t_cancel_token.tryGet();
+    return token ? token->get() : nullptr;
+}
+
+CancelToken::ptr CancelToken::currentPtr() {
+    CancelToken::ptr* token = t_cancel_token.tryGet();
+    return token ? *token : nullptr;
+}
+
+void CancelToken::setCurrent(ptr token) {
+    t_cancel_token.set(std::move(token));
+}
+
+int CancelToken::currentError() {
+    CancelToken* token = current();
+    int error = token ? token->error() : 0;
+    return error ? error : ECANCELED;
+}
+
+}
@@ -0,0 +1,102 @@
+#ifndef _CANCEL_H_
+#define _CANCEL_H_
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace john {
+
+//取消令牌
+//协程通过协程局部存储持有当前的令牌（TaskGroup和with_deadline为协程设置），令牌被取消后，
+//该协程中挂起的hook IO、sleep、Channel、FiberSemaphore、FiberConditionVariable、Future和Select都尽快返回，
+//errno为令牌的取消原因：主动取消为ECANCELED，截止时间到达为ETIMEDOUT。
+//子令牌在父令牌取消时以相同的原因一起取消，并继承父令牌的截止时间。FiberMutex::lock不可取消，持锁时间应当很短。
+class CancelToken : public std::enable_shared_from_this<CancelToken> {
+public:
+    typedef std::shared_ptr<CancelToken> ptr;
+
+    //创建令牌，parent不为空时成为它的子令牌。截止时间取deadline和父令牌截止时间中较早的一个，
+    //这里只做记录，到期取消由设置截止时间的一方（with_deadline）负责
+    static ptr create(const ptr& parent = nullptr, 
+                      std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
+    ~CancelToken();
+
+    bool isCancelled() const {return m_error.load(std::memory_order_acquire) != 0;}
+    //取消原因，没有取消时为0
+    int error() const {return m_error.load(std::memory_order_acquire);}
+    std::chrono::steady_clock::time_point deadline() const {return m_deadline;}
+    //以error为原因取消令牌并执行所有已注册的回调，只有第一次调用生效
+    void cancel(int error = ECANCELED);
+
+    //注册取消时执行的回调，返回用于撤销的id；令牌已经取消时不注册，返回0
+    //回调在调用cancel的线程上、持有令牌的锁时执行，不能阻塞
+    uint64_t addCallback(std::function<void()> cb);
+    //撤销回调，返回后回调不会再被执行（正在执行的回调已经结束）
+    void removeCallback(uint64_t id);
+
+    //当前协程的令牌，没有时返回nullptr
+    static CancelToken* current();
+    static ptr currentPtr();
+    static void setCurrent(ptr token);
+    //当前协程的令牌的取消原因，用于被取消的等待设置errno；没有令牌或没有取消时为ECANCELED
+    static int currentError();
+
+private:
+    CancelToken() = default;
+
+private:
+    std::atomic<int> m_error{0};
+    std::chrono::steady_clock::time_point m_deadline = std::chrono::steady_clock::time_point::max();
+    //回调中可能撤销同一个令牌上的其他回调（如子令牌析构），因此使用递归锁
+    std::recursive_mutex m_mutex;
+    uint64_t m_nextId = 1;
+    std::vector<std::pair<uint64_t, std::function<void()>>> m_callbacks;
+
+    ptr m_parent;
+    uint64_t m_parentId = 0;
+};
+
+//在作用域内注册取消回调，离开作用域时撤销；token为空时什么也不做
+class CancelRegistration {
+public:
+    CancelRegistration() = default;
+    CancelRegistration(CancelToken* token, std::function<void()> cb) {reset(token, std::move(cb));}
+    CancelRegistration(const CancelRegistration&) = delete;
+    CancelRegistration& operator=(const CancelRegistration&) = delete;
+    ~CancelRegistration() {release();}
+
+    //注册回调，返回false表示令牌已经取消
+    bool reset(CancelToken* token, std::function<void()> cb) {
+        release();
+        if(!token) {
+            return true;
+        }
+        m_id = token->addCallback(std::move(cb));
+        if(m_id == 0) {
+            return false;
+        }
+        m_token = token;
+        return true;
+    }
+
+    void release() {
+        if(m_token) {
+            m_token->removeCallback(m_id);
+            m_token = nullptr;
+            m_id = 0;
+        }
+    }
+
+private:
+    CancelToken* m_token = nullptr;
+    uint64_t m_id = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,290 @@
+#ifndef _CHANNEL_H_
+#define _CHANNEL_H_
+
+#include <cerrno>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include "fiber_sync.h"
+
+namespace john {
+
+//协程之间传递数据的多生产者多消费者通道
+//capacity为缓冲区容量：UNBOUNDED表示无界，发送永远不会挂起；0表示无缓冲，发送方要等到接收方取走数据。
+//通道满时send挂起发送协程，通道空时recv挂起接收协程。
+//有协程在等待时数据直接交给对方，不经过缓冲区；元素只需要支持移动。
+//可以在同一调度器或不同调度器的协程之间使用，只能在调度器中运行的协程里调用会挂起的接口。
+//挂起的send和recv可以被当前协程的CancelToken取消，此时返回false，errno为取消原因（ECANCELED或ETIMEDOUT）。
+template<class T>
+class Channel {
+public:
+    static const size_t UNBOUNDED = (size_t)-1;
+
+    explicit Channel(size_t capacity = UNBOUNDED) : m_capacity(capacity) {}
+
+    //发送一个元素，通道已关闭时返回false
+    bool send(T value) {
+        Waiter w;
+        CancelRegistration reg;
+        armCancel(reg, w, m_senders);
+        {
+            std::lock_guard<SpinLock> lock(m_lock);
+            if(m_closed) {
+                return false;
+            }
+            if(handoff(value)) {
+                return true;
+            }
+            if(m_buffer.size() < m_capacity) {
+                m_buffer.push_back(std::move(value));
+                return true;
+            }
+            if(w.cancelled) {
+                set_errno(CancelToken::currentError());
+                return false;
+            }
+            w.value = &value;
+            w.waiter = FiberWaiter::current();
+            w.queued = true;
+            m_senders.push_back(&w);
+        }
+        //被唤醒时value已经被接收方取走，或者通道已经关闭，或者被取消
+        Fiber::getThis()->yield();
+        if(w.cancelled) {
+            set_errno(CancelToken::currentError());
+        }
+        return w.ok;
+    }
+
+    //不挂起的发送，通道满或已关闭时返回false，value保持不变
+    bool trySend(T& value) {
+        std::lock_guard<SpinLock> lock(m_lock);
+        if(m_closed) {
+            return false;
+        }
+        if(handoff(value)) {
+            return true;
+        }
+        if(m_buffer.size() < m_capacity) {
+            m_buffer.push_back(std::move(value));
+            return true;
+        }
+        return false;
+    }
+
+    //接收一个元素，通道已关闭且没有剩余数据时返回false
+    bool recv(T& out) {
+        Waiter w;
+        CancelRegistration reg;
+        armCancel(reg, w, m_receivers);
+        {
+            std::lock_guard<SpinLock> lock(m_lock);
+            if(take(out)) {
+                return true;
+            }
+            if(m_closed) {
+                return false;
+            }
+            if(w.cancelled) {
+                set_errno(CancelToken::currentError());
+                return false;
+            }
+            w.value = &out;
+            w.waiter = FiberWaiter::current();
+            w.queued = true;
+            m_receivers.push_back(&w);
+        }
+        //被唤醒时发送方已经把数据写入out，或者通道已经关闭，或者被取消
+        Fiber::getThis()->yield();
+        if(w.cancelled) {
+            set_errno(CancelToken::currentError());
+        }
+        return w.ok;
+    }
+
+    //不挂起的接收，没有数据时返回false
+    bool tryRecv(T& out) {
+        std::lock_guard<SpinLock> lock(m_lock);
+        return take(out);
+    }
+
+    //关闭通道：之后的send都失败，等待中的发送方和接收方全部唤醒，缓冲区中剩余的数据仍然可以接收
+    void close() {
+        std::deque<Waiter*> waiters;
+        {
+            std::lock_guard<SpinLock> lock(m_lock);
+            if(m_closed) {
+                return;
+            }
+            m_closed = true;
+            waiters.swap(m_senders);
+            //Select登记的接收方必须在锁内claim：claim失败的可能已经撤销登记并返回，出了锁就不能再访问
+            for(Waiter* w : m_receivers) {
+                if(w->claim()) {
+                    waiters.push_back(w);
+                }
+            }
+            m_receivers.clear();
+        }
+        for(Waiter* w : waiters) {
+            //wake之后等待方可能立即返回并销毁w，先取出waiter
+            FiberWaiter fw = w->token ? w->token->waiter : std::move(w->waiter);
+            w->ok = false;
+            fw.wake();
+        }
+    }
+
+    bool isClosed() {
+        std::lock_guard<SpinLock> lock(m_lock);
+        return m_closed;
+    }
+
+    //缓冲区中的元素个数，不含挂起的发送方手中的数据
+    size_t size() {
+        std::lock_guard<SpinLock> lock(m_lock);
+        return m_buffer.size();
+    }
+
+    size_t capacity() const {return m_capacity;}
+
+    //挂起的发送方或接收方，分配在等待协程自己的栈上
+    struct Waiter {
+        T* value = nullptr; //发送方：待发送的数据；接收方：接收数据的位置
+        FiberWaiter waiter;
+        bool ok = true;
+        bool queued = false;    //已经进入等待队列
+        bool cancelled = false; //被CancelToken取消
+        //由Select登记的接收方：交付数据前必须先claim成功
+        WakeToken* token = nullptr;
+        int index = -1;
+
+        bool claim() {return !token || token->claim(index);}
+        void wake() {
+            if(token) {
+                token->waiter.wake();
+            } else {
+                waiter.wake();
+            }
+        }
+    };
+
+    //供Select和无栈协程使用：能立即完成时发送并返回true，通道已关闭时w.ok为false；否则登记w并返回false
+    bool armSend(Waiter& w) {
+        std::lock_guard<SpinLock> lock(m_lock);
+        if(m_closed) {
+            w.ok = false;
+            return true;
+        }
+        if(handoff(*w.value)) {
+            return true;
+        }
+        if(m_buffer.size() < m_capacity) {
+            m_buffer.push_back(std::move(*w.value));
+            return true;
+        }
+        m_senders.push_back(&w);
+        return false;
+    }
+
+    //供Select和无栈协程使用：能立即完成（有数据或通道已关闭）时claim后直接接收并返回true，
+    //claim失败说明其他等待源已经胜出，同样返回true；否则登记w并返回false
+    bool armRecv(Waiter& w) {
+        std::lock_guard<SpinLock> lock(m_lock);
+        if(!m_buffer.empty() || !m_senders.empty() || m_closed) {
+            if(w.claim()) {
+                w.ok = take(*w.value);
+            }
+            return true;
+        }
+        m_receivers.push_back(&w);
+        return false;
+    }
+
+    //供Select使用：撤销armRecv登记的接收方
+    void disarmRecv(Waiter& w) {
+        std::lock_guard<SpinLock> lock(m_lock);
+        for(auto it = m_receivers.begin(); it != m_receivers.end(); ++it) {
+            if(*it == &w) {
+                m_receivers.erase(it);
+                break;
+            }
+        }
+    }
+
+private:
+    //登记取消回调：令牌取消时，如果w还在queue中就摘除并唤醒它；w还没有入队时只做标记，由入队前的检查处理
+    void armCancel(CancelRegistration& reg, Waiter& w, std::deque<Waiter*>& queue) {
+        bool armed = reg.reset(CancelToken::current(), [this, &w, &queue]() {
+            std::lock_guard<SpinLock> lock(m_lock);
+            if(!w.queued) {
+                w.cancelled = true;
+                return;
+            }
+            for(auto it = queue.begin(); it != queue.end(); ++it) {
+                if(*it == &w) {
+                    queue.erase(it);
+                    w.cancelled = true;
+                    w.ok = false;
+                    w.waiter.wake();
+                    return;
+                }
+            }
+        });
+        if(!armed) {
+            w.cancelled = true;
+        }
+    }
+
+    //有接收方在等待时，把value直接交给队首的接收方。调用时持有m_lock
+    bool handoff(T& value) {
+        while(!m_receivers.empty()) {
+            Waiter* r = m_receivers.front();
+            m_receivers.pop_front();
+            //Select登记的接收方可能已经被其他等待源唤醒，跳过
+            if(!r->claim()) {
+                continue;
+            }
+            *r->value = std::move(value);
+            //唤醒放在锁内：调度器只负责把协程放入任务队列，接收方真正运行时会先在Fiber::m_mutex上等待本次yield完成
+            r->wake();
+            return true;
+        }
+        return false;
+    }
+
+    //从缓冲区或挂起的发送方取出一个元素，并让一个挂起的发送方补进缓冲区。调用时持有m_lock
+    bool take(T& out) {
+        if(!m_buffer.empty()) {
+            out = std::move(m_buffer.front());
+            m_buffer.pop_front();
+            if(!m_senders.empty()) {
+                Waiter* s = m_senders.front();
+                m_senders.pop_front();
+                m_buffer.push_back(std::move(*s->value));
+                s->waiter.wake();
+            }
+            return true;
+        }
+        //无缓冲通道，或缓冲区为空时直接从发送方取
+        if(!m_senders.empty()) {
+            Waiter* s = m_senders.front();
+            m_senders.pop_front();
+            out = std::move(*s->value);
+            s->waiter.wake();
+            return true;
+        }
+        return false;
+    }
+
+private:
+    size_t m_capacity;
+    SpinLock m_lock;
+    bool m_closed = false;
+    std::deque<T> m_buffer;
+    std::deque<Waiter*> m_senders;
+    std::deque<Waiter*> m_receivers;
+};
+
+}
+
+#endif
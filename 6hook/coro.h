@@ -0,0 +1,324 @@
+#ifndef _CORO_H_
+#define _CORO_H_
+
+//C++20无栈协程，与Fiber运行在同一个调度器的工作线程上
+//需要用-std=c++20编译，-std=c++17下本头文件为空，其余模块不受影响。
+//
+//协程帧分配在堆上，挂起时不占用栈：恢复执行时借用调度器任务所在的协程栈，挂起后立即归还，
+//适合大量连接同时挂起的场景。与Fiber的互通：
+//  - spawn(sc, task)把Task放入调度器执行，返回Future，Fiber可以用get()等待它
+//  - co_await Future等待submit等返回的结果，Task中可以等待Fiber任务
+//  - Channel两边可以分别是Fiber和Task
+//Task之间的co_await通过对称转移切换，开启优化（-O2）时编译为尾调用，未优化的构建中很深的co_await链会用满借用的协程栈。
+//在Task中不要调用会被hook挂起的阻塞函数，那样会挂起借用的协程栈；应当先co_await readable/writable再调用非阻塞IO。
+//
+//  john::Task<> echo(int fd) {
+//      char buf[4096];
+//      while(true) {
+//          ssize_t n = read(fd, buf, sizeof(buf));
+//          if(n < 0 && errno == EAGAIN) {
+//              co_await john::readable(fd);
+//              continue;
+//          }
+//          ...
+//      }
+//  }
+//  john::spawn(&iom, echo(fd));
+
+#if __cplusplus >= 202002L
+
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+#include "channel.h"
+#include "future.h"
+#include "ioscheduler.h"
+
+namespace john {
+
+template<class T = void>
+class Task;
+
+namespace detail {
+
+//把协程句柄包装成FiberWaiter，放进fiber_sync和Channel已有的等待队列
+inline FiberWaiter coro_waiter(std::coroutine_handle<> h) {
+    FiberWaiter w;
+    w.scheduler = Scheduler::getThis();
+    assert(w.scheduler);
+    w.resume = [](void* p) {
+        std::coroutine_handle<>::from_address(p).resume();
+    };
+    w.handle = h.address();
+    return w;
+}
+
+//把协程的恢复作为任务放入调度器
+inline void schedule_resume(Scheduler* sc, std::coroutine_handle<> h) {
+    sc->schedulerLock(std::function<void()>([h]() {
+        h.resume();
+    }));
+}
+
+struct TaskPromiseBase {
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+    std::exception_ptr error;
+
+    //Task是惰性的，被co_await或spawn时才开始执行
+    std::suspend_always initial_suspend() noexcept {return {};}
+
+    //结束时直接切换到等待它的协程（对称转移），不经过调度器，也不会加深调用栈
+    struct FinalAwaiter {
+        bool await_ready() noexcept {return false;}
+        template<class P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+            return h.promise().continuation;
+        }
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept {return {};}
+
+    void unhandled_exception() {error = std::current_exception();}
+};
+
+template<class T>
+struct TaskPromise : public TaskPromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+
+    template<class U>
+    void return_value(U&& v) {value.emplace(std::forward<U>(v));}
+
+    T result() {
+        if(error) {
+            std::rethrow_exception(error);
+        }
+        return std::move(*value);
+    }
+};
+
+template<>
+struct TaskPromise<void> : public TaskPromiseBase {
+    Task<void> get_return_object();
+
+    void return_void() {}
+
+    void result() {
+        if(error) {
+            std::rethrow_exception(error);
+        }
+    }
+};
+
+}
+
+//无栈协程的返回类型，co_await它得到返回值或重新抛出异常。只能移动，只能co_await一次
+template<class T>
+class Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    Task() = default;
+    explicit Task(handle_type h) : m_handle(h) {}
+    Task(Task&& other) : m_handle(std::exchange(other.m_handle, nullptr)) {}
+    Task& operator=(Task&& other) {
+        if(this != &other) {
+            if(m_handle) {
+                m_handle.destroy();
+            }
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+    ~Task() {
+        if(m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    bool valid() const {return (bool)m_handle;}
+
+    struct Awaiter {
+        handle_type handle;
+
+        bool await_ready() {return handle.done();}
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) {
+            handle.promise().continuation = h;
+            return handle;
+        }
+        T await_resume() {return handle.promise().result();}
+    };
+
+    Awaiter operator co_await() const & {return Awaiter{m_handle};}
+    Awaiter operator co_await() const && {return Awaiter{m_handle};}
+
+private:
+    handle_type m_handle;
+};
+
+namespace detail {
+
+template<class T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+//spawn使用的顶层协程，结束后自动销毁
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() {
+            return Detached{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept {return {};}
+        std::suspend_never final_suspend() noexcept {return {};}
+        void return_void() {}
+        void unhandled_exception() {std::terminate();}
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+template<class T>
+Detached run_detached(Task<T> task, std::shared_ptr<FutureState<T>> state) {
+    try {
+        if constexpr(std::is_void_v<T>) {
+            co_await task;
+            state->setValue();
+        } else {
+            state->setValue(co_await task);
+        }
+    } catch(...) {
+        state->setException(std::current_exception());
+    }
+}
+
+}
+
+//把task放入调度器sc开始执行，返回它的结果；Fiber和普通线程都可以等待这个Future
+template<class T>
+Future<T> spawn(Scheduler* sc, Task<T> task) {
+    auto state = std::make_shared<FutureState<T>>();
+    detail::Detached d = detail::run_detached(std::move(task), state);
+    detail::schedule_resume(sc, d.handle);
+    return Future<T>(state);
+}
+
+//等待fd上的事件就绪，返回0；注册事件失败（如同一事件已被注册）时不挂起，返回-1
+//事件回调由IOManager作为任务调度，回调中直接恢复协程
+struct IOAwaiter {
+    int fd;
+    IOManager::Event event;
+    int rt = 0;
+
+    bool await_ready() {return false;}
+    bool await_suspend(std::coroutine_handle<> h) {
+        IOManager* iom = IOManager::getThis();
+        assert(iom);
+        //注册成功后协程可能立即在其他线程恢复并销毁本对象，之后不能再访问成员
+        if(iom->addEvent(fd, event, [h]() {h.resume();}) != 0) {
+            rt = -1;
+            return false;
+        }
+        return true;
+    }
+    int await_resume() {return rt;}
+};
+
+inline IOAwaiter readable(int fd) {return IOAwaiter{fd, IOManager::READ};}
+inline IOAwaiter writable(int fd) {return IOAwaiter{fd, IOManager::WRITE};}
+
+//挂起一段时间，定时器精度为毫秒，不足1毫秒向上取整
+struct SleepAwaiter {
+    uint64_t ms;
+
+    bool await_ready() {return ms == 0;}
+    void await_suspend(std::coroutine_handle<> h) {
+        IOManager* iom = IOManager::getThis();
+        assert(iom);
+        iom->addTimer(ms, [h]() {h.resume();});
+    }
+    void await_resume() {}
+};
+
+template<class Rep, class Period>
+SleepAwaiter sleep_for(std::chrono::duration<Rep, Period> d) {
+    auto ms = std::chrono::ceil<std::chrono::milliseconds>(d).count();
+    return SleepAwaiter{ms > 0 ? (uint64_t)ms : 0};
+}
+
+//接收一个元素，co_await的结果与Channel::recv相同
+template<class T>
+struct ChannelRecvAwaiter {
+    Channel<T>& channel;
+    T& out;
+    typename Channel<T>::Waiter waiter;
+
+    bool await_ready() {return false;}
+    bool await_suspend(std::coroutine_handle<> h) {
+        waiter.value = &out;
+        waiter.waiter = detail::coro_waiter(h);
+        return !channel.armRecv(waiter);
+    }
+    bool await_resume() {return waiter.ok;}
+};
+
+//发送一个元素，co_await的结果与Channel::send相同
+template<class T>
+struct ChannelSendAwaiter {
+    Channel<T>& channel;
+    T value;
+    typename Channel<T>::Waiter waiter;
+
+    bool await_ready() {return false;}
+    bool await_suspend(std::coroutine_handle<> h) {
+        waiter.value = &value;
+        waiter.waiter = detail::coro_waiter(h);
+        return !channel.armSend(waiter);
+    }
+    bool await_resume() {return waiter.ok;}
+};
+
+template<class T>
+ChannelRecvAwaiter<T> async_recv(Channel<T>& ch, T& out) {return ChannelRecvAwaiter<T>{ch, out, {}};}
+
+template<class T>
+ChannelSendAwaiter<T> async_send(Channel<T>& ch, T value) {return ChannelSendAwaiter<T>{ch, std::move(value), {}};}
+
+//co_await Future：结果就绪后由等待时所在的调度器恢复协程。结果从共享状态中移走
+template<class T>
+struct FutureAwaiter {
+    Future<T> future;
+
+    bool await_ready() {return future.isReady();}
+    void await_suspend(std::coroutine_handle<> h) {
+        Scheduler* sc = Scheduler::getThis();
+        assert(sc);
+        future.state()->addCallback([sc, h]() {
+            detail::schedule_resume(sc, h);
+        });
+    }
+    T await_resume() {
+        if constexpr(std::is_void_v<T>) {
+            future.get();
+        } else {
+            return std::move(future.get());
+        }
+    }
+};
+
+template<class T>
+FutureAwaiter<T> operator co_await(Future<T> future) {return FutureAwaiter<T>{std::move(future)};}
+
+}
+
+#endif
+
+#endif
@@ -0,0 +1,44 @@
+#include "deadline.h"
+#include <cassert>
+#include <cerrno>
+#include "ioscheduler.h"
+
+namespace john {
+
+DeadlineScope::DeadlineScope(std::chrono::steady_clock::time_point deadline) 
+    : m_parent(CancelToken::currentPtr())
+    , m_token(CancelToken::create(m_parent, deadline)) {
+    //外层的截止时间不晚于deadline时，由外层的定时器取消父令牌，再传递给这里的子令牌
+    bool tighter = !m_parent || deadline < m_parent->deadline();
+    if(tighter && !m_token->isCancelled()) {
+        auto now = std::chrono::steady_clock::now();
+        if(deadline <= now) {
+            m_token->cancel(ETIMEDOUT);
+        } else {
+            IOManager* iom = IOManager::getThis();
+            assert(iom);
+            std::weak_ptr<CancelToken> weak(m_token);
+            uint64_t ms = std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count();
+            m_timer = iom->addTimer(ms, [weak]() {
+                if(auto token = weak.lock()) {
+                    token->cancel(ETIMEDOUT);
+                }
+            });
+        }
+    }
+    CancelToken::setCurrent(m_token);
+}
+
+DeadlineScope::~DeadlineScope() {
+    if(m_timer) {
+        m_timer->cancel();
+    }
+    CancelToken::setCurrent(m_parent);
+}
+
+std::chrono::steady_clock::time_point current_deadline() {
+    CancelToken* token = CancelToken::current();
+    return token ? token->deadline() : std::chrono::steady_clock::time_point::max();
+}
+
+}
@@ -0,0 +1,59 @@
+#ifndef _DEADLINE_H_
+#define _DEADLINE_H_
+
+#include <chrono>
+#include <memory>
+#include "cancel.h"
+#include "timer.h"
+
+namespace john {
+
+//端到端截止时间
+//在作用域内给当前协程设置一个绝对截止时间：创建当前令牌的子令牌作为新的当前令牌，
+//并只设置一个定时器，到期时以ETIMEDOUT取消它。作用域内挂起的hook IO（connect、recv、send等）、
+//sleep和协程同步原语都在截止时间到达时返回，errno为ETIMEDOUT；
+//hook IO和sleep发现截止时间早于自己的超时（SO_RCVTIMEO等）时不再各自设置定时器。
+//嵌套时取较早的截止时间，在作用域内spawn的TaskGroup子协程也继承它。要求在IOManager中运行的协程里使用。
+//
+//  john::with_timeout(std::chrono::milliseconds(200), [&]() {
+//      connect(fd, addr, len);
+//      send(fd, req, n, 0);
+//      recv(fd, buf, sizeof(buf), 0);
+//  });
+class DeadlineScope {
+public:
+    explicit DeadlineScope(std::chrono::steady_clock::time_point deadline);
+    DeadlineScope(const DeadlineScope&) = delete;
+    DeadlineScope& operator=(const DeadlineScope&) = delete;
+    //恢复原来的令牌，截止时间还没到时撤销定时器
+    ~DeadlineScope();
+
+    const CancelToken::ptr& token() const {return m_token;}
+
+private:
+    CancelToken::ptr m_parent;
+    CancelToken::ptr m_token;
+    std::shared_ptr<Timer> m_timer;
+};
+
+//在截止时间deadline内执行fn，返回fn的结果
+template<class F>
+auto with_deadline(std::chrono::steady_clock::time_point deadline, F&& fn) -> decltype(fn()) {
+    DeadlineScope scope(deadline);
+    return fn();
+}
+
+//在timeout时间内执行fn，返回fn的结果
+template<class Rep, class Period, class F>
+auto with_timeout(std::chrono::duration<Rep, Period> timeout, F&& fn) -> decltype(fn()) {
+    DeadlineScope scope(std::chrono::steady_clock::now() 
+        + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout));
+    return fn();
+}
+
+//当前协程的截止时间，没有时返回time_point::max()，可以用来把剩余时间传给下游服务
+std::chrono::steady_clock::time_point current_deadline();
+
+}
+
+#endif
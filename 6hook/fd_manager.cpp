@@ -7,22 +7,22 @@
 
 namespace john{
 
-// instantiate
-template class Singleton<FdManager>;
-
-// Static variables need to be defined outside the class
-template<typename T>
-T* Singleton<T>::instance = nullptr;
-
-template<typename T>
-std::mutex Singleton<T>::mutex;	
-
 FdCtx::FdCtx(int fd):
 m_fd(fd)
 {
 	init();
 }
 
+FdCtx::FdCtx(int fd, bool is_socket):
+m_isInit(true),
+m_isSocket(is_socket),
+m_isPollable(true),
+m_sysNonblock(true),
+m_fd(fd)
+{
+
+}
+
 FdCtx::~FdCtx()
 {
 
@@ -46,6 +46,9 @@ bool FdCtx::init()
 	{
 		m_isInit = true;	
 		m_isSocket = S_ISSOCK(statbuf.st_mode);	
+		m_isRegular = S_ISREG(statbuf.st_mode);
+		// 外部传入的管道等fd可能与其他进程共享，不擅自改为非阻塞，只有socket交给epoll
+		m_isPollable = m_isSocket;
 	}
 
 	// if it is a socket -> set to nonblock
@@ -92,6 +95,13 @@ uint64_t FdCtx::getTimeout(int type)
 	}
 }
 
+std::shared_ptr<FdCtx> FdCtx::clone(int fd) const
+{
+	std::shared_ptr<FdCtx> ctx = std::make_shared<FdCtx>(*this);
+	ctx->m_fd = fd;
+	return ctx;
+}
+
 FdManager::FdManager()
 {
 	m_datas.resize(64);
@@ -143,4 +153,47 @@ void FdManager::del(int fd)
 	m_datas[fd].reset();
 }
 
-}
\ No newline at end of file
+std::shared_ptr<FdCtx> FdManager::add(int fd, bool is_socket, bool user_nonblock)
+{
+	if(fd < 0)
+	{
+		return nullptr;
+	}
+
+	std::shared_ptr<FdCtx> ctx = std::make_shared<FdCtx>(fd, is_socket);
+	ctx->setUserNonblock(user_nonblock);
+
+	std::unique_lock<std::shared_mutex> write_lock(m_mutex);
+	if(m_datas.size() <= (size_t)fd)
+	{
+		m_datas.resize(fd*1.5 + 1);
+	}
+	m_datas[fd] = ctx;
+	return ctx;
+}
+
+void FdManager::dup(int oldfd, int newfd)
+{
+	if(oldfd < 0 || newfd < 0)
+	{
+		return;
+	}
+
+	std::unique_lock<std::shared_mutex> write_lock(m_mutex);
+	if(m_datas.size() <= (size_t)newfd)
+	{
+		m_datas.resize(newfd*1.5 + 1);
+	}
+
+	// 原fd没有上下文时只清掉newfd上残留的旧状态，之后按需重新创建
+	if(m_datas.size() > (size_t)oldfd && m_datas[oldfd])
+	{
+		m_datas[newfd] = m_datas[oldfd]->clone(newfd);
+	}
+	else
+	{
+		m_datas[newfd].reset();
+	}
+}
+
+}
@@ -3,6 +3,8 @@
 
 #include <memory>
 #include <shared_mutex>
+#include <atomic>
+#include <vector>
 #include "thread.h"
 
 namespace john{
@@ -13,6 +15,9 @@ class FdCtx : public std::enable_shared_from_this<FdCtx>
 private:
 	bool m_isInit = false;
 	bool m_isSocket = false;
+	bool m_isRegular = false;
+	// 能交给epoll等待的fd：socket，以及通过hook创建的管道、eventfd
+	bool m_isPollable = false;
 	bool m_sysNonblock = false;
 	bool m_userNonblock = false;
 	bool m_isClosed = false;
@@ -23,13 +28,23 @@ private:
 	// write event timeout
 	uint64_t m_sendTimeout = (uint64_t)-1;
 
+	// MSG_ZEROCOPY状态：0未设置，1已开启SO_ZEROCOPY，-1不支持
+	int m_zerocopy = 0;
+	// 下一次零拷贝发送的序号，以及已完成发送的序号上界（不含），与内核的计数方式一致
+	uint32_t m_zcNext = 0;
+	uint32_t m_zcDone = 0;
+
 public:
 	FdCtx(int fd);
+	// 通过hook创建且已经设置为非阻塞的fd，类型已知，无需fstat和fcntl
+	FdCtx(int fd, bool is_socket);
 	~FdCtx();
 
 	bool init();
 	bool isInit() const {return m_isInit;}
 	bool isSocket() const {return m_isSocket;}
+	bool isRegularFile() const {return m_isRegular;}
+	bool isPollable() const {return m_isPollable;}
 	bool isClosed() const {return m_isClosed;}
 
 	void setUserNonblock(bool v) {m_userNonblock = v;}
@@ -40,6 +55,23 @@ public:
 
 	void setTimeout(int type, uint64_t v);
 	uint64_t getTimeout(int type);
+
+	void setZerocopy(int v) {m_zerocopy = v;}
+	int getZerocopy() const {return m_zerocopy;}
+	// 分配一次零拷贝发送的序号
+	uint32_t nextZerocopyId() {return m_zcNext++;}
+	// 记录错误队列中完成的区间[lo, hi]，序号会回绕，按差值比较
+	void zerocopyDone(uint32_t hi) 
+	{
+		if((int32_t)(hi + 1 - m_zcDone) > 0) 
+		{
+			m_zcDone = hi + 1;
+		}
+	}
+	bool isZerocopyDone(uint32_t id) const {return (int32_t)(m_zcDone - id) > 0;}
+
+	// dup出的fd与原fd共享同一个打开的文件，复制一份状态给新fd
+	std::shared_ptr<FdCtx> clone(int fd) const;
 };
 
 class FdManager
@@ -50,6 +82,11 @@ public:
 	std::shared_ptr<FdCtx> get(int fd, bool auto_create = false);
 	void del(int fd);
 
+	// 登记一个刚由hook创建的非阻塞fd，覆盖该编号上可能残留的旧上下文
+	std::shared_ptr<FdCtx> add(int fd, bool is_socket, bool user_nonblock);
+	// dup/dup2/dup3之后，让newfd继承oldfd的上下文
+	void dup(int oldfd, int newfd);
+
 private:
 	std::shared_mutex m_mutex;
 	std::vector<std::shared_ptr<FdCtx>> m_datas;
@@ -60,8 +97,9 @@ template<typename T>
 class Singleton
 {
 private:
-    static T* instance;
-    static std::mutex mutex;
+    // 初始化完成后只做一次acquire读取，hook快速路径不再竞争全局互斥锁
+    static inline std::atomic<T*> instance{nullptr};
+    static inline std::mutex mutex;
 
 protected:
     Singleton() {}  
@@ -73,19 +111,25 @@ public:
 
     static T* GetInstance() 
     {
-        std::lock_guard<std::mutex> lock(mutex); // Ensure thread safety
-        if (instance == nullptr) 
+        T* tmp = instance.load(std::memory_order_acquire);
+        if (tmp == nullptr) 
         {
-            instance = new T();
+            // double-checked locking: only the first callers take the lock
+            std::lock_guard<std::mutex> lock(mutex);
+            tmp = instance.load(std::memory_order_relaxed);
+            if (tmp == nullptr) 
+            {
+                tmp = new T();
+                instance.store(tmp, std::memory_order_release);
+            }
         }
-        return instance;
+        return tmp;
     }
 
     static void DestroyInstance() 
     {
         std::lock_guard<std::mutex> lock(mutex);
-        delete instance;
-        instance = nullptr;
+        delete instance.exchange(nullptr, std::memory_order_acq_rel);
     }
 };
 
@@ -1,12 +1,13 @@
 #include "fiber.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
 
 static bool debug = false;
 
 namespace john {
 
- //正在运行的协程
- //thread_local存储每个线程中正在运行的协程,每个线程有独立的数据副本
-static thread_local Fiber* t_fiber = nullptr;
+//正在运行的协程t_fiber是Fiber的静态成员，见fiber.h
 //线程中的主协程
 static thread_local std::shared_ptr<Fiber> t_thread_fiber = nullptr;
 //线程中的调度协程
@@ -17,6 +18,10 @@ static std::atomic<uint64_t> s_fiber_id{0};
 //协程计数器
 static std::atomic<uint64_t> s_fiber_count{0};
 
+//已分配的协程局部存储槽位及其析构函数
+static std::atomic<size_t> s_local_count{0};
+static void (*s_local_dtors[Fiber::MAX_LOCALS])(void*);
+
 void Fiber::setThis(Fiber* f) {
     t_fiber = f;
 }
@@ -46,6 +51,33 @@ uint64_t Fiber::getFiberID() {
     return (uint64_t)-1;
 }
 
+size_t Fiber::allocLocalSlot(void (*dtor)(void*)) {
+    size_t slot = s_local_count.fetch_add(1);
+    //槽位用尽时继续运行会越界写m_locals和s_local_dtors，release构建下同样直接终止
+    if(slot >= MAX_LOCALS) {
+        std::cerr << "Fiber::allocLocalSlot failed: more than " << MAX_LOCALS << " FiberLocal keys\n";
+        abort();
+    }
+    s_local_dtors[slot] = dtor;
+    return slot;
+}
+
+void Fiber::clearLocals() {
+    size_t count = std::min(s_local_count.load(), MAX_LOCALS);
+    for(size_t i = 0; i < count; ++i) {
+        //先置空再析构，析构函数中访问同一个key时会得到新值，而不是已经销毁的对象
+        void* p = m_locals[i];
+        if(p) {
+            m_locals[i] = nullptr;
+            s_local_dtors[i](p);
+        }
+    }
+}
+
+bool Fiber::inFiber() {
+    return t_fiber && t_fiber != t_thread_fiber.get() && t_fiber != t_scheduler_fiber && t_fiber->m_runInScheduler;
+}
+
 Fiber::Fiber() {
     setThis(this);
     m_state = RUNING;
@@ -85,6 +117,7 @@ m_cb(cb), m_runInScheduler(run_in_scheduler) {
 }
 
 Fiber::~Fiber() {
+    clearLocals();
     s_fiber_count--;
     if(m_stack) {
         free(m_stack);
@@ -95,6 +128,7 @@ Fiber::~Fiber() {
 void Fiber::reset(std::function<void()> cb) {
     assert(m_stack != nullptr && m_state == TERM);
 
+    clearLocals();
     m_state = READY;
     m_cb = cb;
 
@@ -159,6 +193,8 @@ void Fiber::fiberFunc() {
     //开始运行函数
     cur->m_cb();
     cur->m_cb = nullptr;
+    //在协程自己的栈上销毁局部存储，此时getThis仍然是当前协程
+    cur->clearLocals();
     cur->m_state = TERM;
 
     //运行结束，让出执行权
@@ -167,4 +203,8 @@ void Fiber::fiberFunc() {
     raw_ptr->yield();
 }
 
-}
\ No newline at end of file
+void set_errno(int err) {
+    errno = err;
+}
+
+}
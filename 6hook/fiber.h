@@ -41,6 +41,9 @@ public:
 
     uint64_t getID() const {return m_id;}
     State getState() const {return m_state;}
+    //调度优先级，取值见Scheduler::Priority。协程再次被调度（IO就绪、被唤醒）时沿用它
+    int getPriority() const {return m_priority;}
+    void setPriority(int priority) {m_priority = priority;}
 
 public:
     //设置当前运行的协程
@@ -51,6 +54,20 @@ public:
     static void setSchedulerFiber(Fiber* f);
     //获得当前运行协程的ID
     static uint64_t getFiberID();
+    //当前是否运行在由调度协程切换进来的子协程中，此时才能yield挂起等待
+    static bool inFiber();
+    //获得当前运行的协程的裸指针，不增加引用计数；线程中还没有协程时创建主协程
+    static Fiber* getThisPtr() {return t_fiber ? t_fiber : getThis().get();}
+
+public:
+    //协程局部存储的槽位数（见fiber_local.h）
+    static constexpr size_t MAX_LOCALS = 16;
+    //分配一个协程局部存储槽位，dtor用于在协程结束或reset时销毁槽中的值。槽位只分配不回收，
+    //超过MAX_LOCALS个时打印错误并终止程序
+    static size_t allocLocalSlot(void (*dtor)(void*));
+    void*& localSlot(size_t slot) {return m_locals[slot];}
+    //销毁所有协程局部存储的值
+    void clearLocals();
     //协程函数
     static void fiberFunc();
 
@@ -64,11 +81,22 @@ private:
 
     std::function<void()> m_cb; //协程函数
 
-    bool m_runInScheduler; // 是否让出执行权交给调度协程
+    bool m_runInScheduler = false; // 是否让出执行权交给调度协程
+
+    int m_priority = 1; //调度优先级，默认Scheduler::PRIORITY_NORMAL
+
+    void* m_locals[MAX_LOCALS] = {}; //协程局部存储
+
+    //正在运行的协程，定义在头文件中使getThisPtr可以内联，访问开销与普通thread_local相同
+    static inline thread_local Fiber* t_fiber = nullptr;
 public:
     std::mutex m_mutex;
 };
 
+//协程挂起后可能在另一个线程上恢复，而__errno_location被声明为const，编译器会复用挂起前取得的errno地址，
+//把错误码写到原来的线程上。挂起之后设置errno要调用这个函数，它在fiber.cpp中每次重新取当前线程的errno
+void set_errno(int err);
+
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,60 @@
+#ifndef _FIBER_LOCAL_H_
+#define _FIBER_LOCAL_H_
+
+#include "fiber.h"
+
+namespace john {
+
+//协程局部存储：每个协程各自持有一份T，协程在工作线程之间迁移时跟随协程，而thread_local会跟随线程
+//key应当定义为静态或全局对象，构造时分配Fiber内的一个槽位（最多Fiber::MAX_LOCALS个），访问时直接按下标取槽，
+//第一次访问时默认构造，协程结束或reset时析构。没有运行在子协程中时访问的是线程主协程的那一份。
+//无栈协程（coro.h）借用调度器的协程运行，不能使用协程局部存储。
+//
+//  static john::FiberLocal<std::string> t_trace_id;
+//  *t_trace_id = "abc";
+template<class T>
+class FiberLocal {
+public:
+    FiberLocal() : m_slot(Fiber::allocLocalSlot(&FiberLocal::destroy)) {}
+    FiberLocal(const FiberLocal&) = delete;
+    FiberLocal& operator=(const FiberLocal&) = delete;
+
+    T& get() {
+        void*& p = Fiber::getThisPtr()->localSlot(m_slot);
+        if(!p) {
+            p = new T();
+        }
+        return *(T*)p;
+    }
+
+    //当前协程还没有值时返回nullptr，不会构造
+    T* tryGet() const {return (T*)Fiber::getThisPtr()->localSlot(m_slot);}
+
+    T& operator*() {return get();}
+    T* operator->() {return &get();}
+
+    void set(T value) {get() = std::move(value);}
+
+    //当前协程是否已经有值
+    bool has() const {return tryGet() != nullptr;}
+
+    //销毁当前协程的值，下次访问时重新构造
+    void reset() {
+        void*& p = Fiber::getThisPtr()->localSlot(m_slot);
+        if(p) {
+            T* value = (T*)p;
+            p = nullptr;
+            delete value;
+        }
+    }
+
+private:
+    static void destroy(void* p) {delete (T*)p;}
+
+private:
+    size_t m_slot;
+};
+
+}
+
+#endif
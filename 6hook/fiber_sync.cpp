@@ -0,0 +1,209 @@
+#include "fiber_sync.h"
+#include <cerrno>
+
+namespace john {
+
+FiberWaiter FiberWaiter::current() {
+    FiberWaiter w;
+    w.scheduler = Scheduler::getThis();
+    w.fiber = Fiber::getThis();
+    assert(w.scheduler);
+    return w;
+}
+
+//协程可能在真正yield之前就被其他线程取出，此时那个线程会在Fiber::m_mutex上等待yield完成后再resume
+//唤醒方是同一调度器的任务协程时直接交接给本线程，见Scheduler::scheduleHandoff
+void FiberWaiter::wake() {
+    if(resume) {
+        auto fn = resume;
+        void* h = handle;
+        scheduler->schedulerLock(std::function<void()>([fn, h]() {
+            fn(h);
+        }));
+        return;
+    }
+    if(scheduler == Scheduler::getThis()) {
+        std::shared_ptr<Fiber> f = fiber;
+        if(Scheduler::scheduleHandoff(&f)) {
+            return;
+        }
+    }
+    scheduler->schedulerLock(fiber);
+}
+
+CancellableWait::CancellableWait(SpinLock& lock, std::deque<FiberWaiter>& waiters, bool cancellable)
+    : m_lock(lock)
+    , m_waiters(waiters) {
+    //令牌已经取消时不注册回调，enqueue直接失败
+    if(cancellable && !m_reg.reset(CancelToken::current(), [this]() {onCancel();})) {
+        m_cancelled = true;
+    }
+}
+
+bool CancellableWait::enqueue(bool front) {
+    if(m_cancelled) {
+        return false;
+    }
+    FiberWaiter w = FiberWaiter::current();
+    m_fiber = w.fiber.get();
+    if(front) {
+        m_waiters.push_front(std::move(w));
+    } else {
+        m_waiters.push_back(std::move(w));
+    }
+    m_enqueued = true;
+    return true;
+}
+
+void CancellableWait::onCancel() {
+    std::lock_guard<SpinLock> lock(m_lock);
+    if(!m_enqueued) {
+        m_cancelled = true;
+        return;
+    }
+    for(auto it = m_waiters.begin(); it != m_waiters.end(); ++it) {
+        if(it->fiber.get() == m_fiber) {
+            FiberWaiter w = std::move(*it);
+            m_waiters.erase(it);
+            m_cancelled = true;
+            w.wake();
+            return;
+        }
+    }
+}
+
+void FiberMutex::lock() {
+    bool requeue = false;
+    while(true) {
+        {
+            std::lock_guard<SpinLock> lock(m_lock);
+            if(!m_locked) {
+                m_locked = true;
+                return;
+            }
+            //被唤醒后又被其他协程抢先拿到锁时，回到队首，保持等待顺序
+            if(requeue) {
+                m_waiters.push_front(FiberWaiter::current());
+            } else {
+                m_waiters.push_back(FiberWaiter::current());
+            }
+        }
+        Fiber::getThis()->yield();
+        requeue = true;
+    }
+}
+
+bool FiberMutex::try_lock() {
+    std::lock_guard<SpinLock> lock(m_lock);
+    if(m_locked) {
+        return false;
+    }
+    m_locked = true;
+    return true;
+}
+
+void FiberMutex::unlock() {
+    FiberWaiter w;
+    {
+        std::lock_guard<SpinLock> lock(m_lock);
+        assert(m_locked);
+        m_locked = false;
+        if(m_waiters.empty()) {
+            return;
+        }
+        w = std::move(m_waiters.front());
+        m_waiters.pop_front();
+    }
+    w.wake();
+}
+
+bool FiberConditionVariable::wait(FiberMutex& mutex) {
+    CancellableWait cw(m_lock, m_waiters);
+    //先入队再释放mutex，notify不会在两者之间丢失
+    {
+        std::lock_guard<SpinLock> lock(m_lock);
+        if(!cw.enqueue()) {
+            set_errno(CancelToken::currentError());
+            return false;
+        }
+    }
+    mutex.unlock();
+    Fiber::getThis()->yield();
+    mutex.lock();
+    if(cw.cancelled()) {
+        set_errno(CancelToken::currentError());
+        return false;
+    }
+    return true;
+}
+
+void FiberConditionVariable::notify_one() {
+    FiberWaiter w;
+    {
+        std::lock_guard<SpinLock> lock(m_lock);
+        if(m_waiters.empty()) {
+            return;
+        }
+        w = std::move(m_waiters.front());
+        m_waiters.pop_front();
+    }
+    w.wake();
+}
+
+void FiberConditionVariable::notify_all() {
+    std::deque<FiberWaiter> waiters;
+    {
+        std::lock_guard<SpinLock> lock(m_lock);
+        waiters.swap(m_waiters);
+    }
+    for(auto& w : waiters) {
+        w.wake();
+    }
+}
+
+bool FiberSemaphore::wait() {
+    CancellableWait cw(m_lock, m_waiters);
+    {
+        std::lock_guard<SpinLock> lock(m_lock);
+        if(m_count > 0) {
+            --m_count;
+            return true;
+        }
+        if(!cw.enqueue()) {
+            set_errno(CancelToken::currentError());
+            return false;
+        }
+    }
+    //没有被取消时，资源已经由signal直接交给了当前协程
+    Fiber::getThis()->yield();
+    if(cw.cancelled()) {
+        set_errno(CancelToken::currentError());
+        return false;
+    }
+    return true;
+}
+
+bool FiberSemaphore::tryWait() {
+    std::lock_guard<SpinLock> lock(m_lock);
+    if(m_count > 0) {
+        --m_count;
+        return true;
+    }
+    return false;
+}
+
+void FiberSemaphore::signal() {
+    FiberWaiter w;
+    {
+        std::lock_guard<SpinLock> lock(m_lock);
+        if(m_waiters.empty()) {
+            ++m_count;
+            return;
+        }
+        w = std::move(m_waiters.front());
+        m_waiters.pop_front();
+    }
+    w.wake();
+}
+
+}
@@ -0,0 +1,136 @@
+#ifndef _FIBER_SYNC_H_
+#define _FIBER_SYNC_H_
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include "fiber.h"
+#include "thread.h"
+#include "scheduler.h"
+#include "cancel.h"
+
+namespace john {
+
+//协程级别的同步原语
+//等待时把当前协程挂到等待队列上并yield，让出的是协程而不是工作线程；
+//被唤醒时通过协程所属的调度器重新调度。只能在调度器中运行的协程里使用。
+//等待队列本身由SpinLock保护，临界区只有几条指令。
+
+//等待中的协程及其所属的调度器
+//等待方也可以是C++20的无栈协程（见coro.h）：此时fiber为空，wake时把resume(handle)作为任务放入调度器
+struct FiberWaiter {
+    Scheduler* scheduler = nullptr;
+    std::shared_ptr<Fiber> fiber;
+    void (*resume)(void*) = nullptr;
+    void* handle = nullptr;
+
+    //以当前协程构造
+    static FiberWaiter current();
+    //把协程放回调度器
+    void wake();
+};
+
+//一个协程同时在多个等待源上挂起时共享的唤醒状态（见Select）
+//等待源就绪时先claim，只有第一个成功的等待源负责唤醒协程，其余的放弃
+struct WakeToken {
+    std::atomic<int> winner{-1};
+    FiberWaiter waiter;
+
+    bool claim(int index) {
+        int expected = -1;
+        return winner.compare_exchange_strong(expected, index);
+    }
+};
+
+//可取消的等待：把当前协程放进由lock保护的FiberWaiter队列，
+//当前协程的CancelToken被取消时，由取消回调在lock内把协程从队列中摘除并唤醒。
+//已经被正常唤醒方取出的协程不受影响，保证协程只被唤醒一次。构造在加锁之前，析构在协程被唤醒之后
+class CancellableWait {
+public:
+    //cancellable为false时不注册取消回调，退化为普通的等待
+    CancellableWait(SpinLock& lock, std::deque<FiberWaiter>& waiters, bool cancellable = true);
+
+    //持有lock时调用：已经取消时返回false，否则把当前协程放入队列
+    bool enqueue(bool front = false);
+    //被唤醒后调用：是否因为取消而被唤醒
+    bool cancelled() const {return m_cancelled;}
+
+private:
+    void onCancel();
+
+private:
+    SpinLock& m_lock;
+    std::deque<FiberWaiter>& m_waiters;
+    Fiber* m_fiber = nullptr;
+    bool m_enqueued = false;
+    bool m_cancelled = false;
+    CancelRegistration m_reg;
+};
+
+//协程互斥锁
+//解锁时只唤醒队首的一个协程，由它重新竞争锁。锁不直接移交，正在运行的协程可以先拿到锁，
+//避免持锁线程被抢占时所有协程排成长队依次经过调度器（lock convoy）；抢锁失败的协程回到队首继续等待
+class FiberMutex {
+public:
+    void lock();
+    bool try_lock();
+    void unlock();
+
+private:
+    SpinLock m_lock;
+    bool m_locked = false;
+    std::deque<FiberWaiter> m_waiters;
+};
+
+//协程条件变量，配合FiberMutex使用，满足std::unique_lock<FiberMutex>的用法
+class FiberConditionVariable {
+public:
+    //释放mutex并挂起当前协程，被唤醒后重新加锁再返回
+    //被取消时返回false，errno为取消原因，返回时仍然持有mutex
+    bool wait(FiberMutex& mutex);
+    bool wait(std::unique_lock<FiberMutex>& lock) {return wait(*lock.mutex());}
+
+    template<class Predicate>
+    bool wait(FiberMutex& mutex, Predicate pred) {
+        while(!pred()) {
+            if(!wait(mutex)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template<class Predicate>
+    bool wait(std::unique_lock<FiberMutex>& lock, Predicate pred) {
+        return wait(*lock.mutex(), pred);
+    }
+
+    void notify_one();
+    void notify_all();
+
+private:
+    SpinLock m_lock;
+    std::deque<FiberWaiter> m_waiters;
+};
+
+//协程信号量
+//signal时如果有等待者，资源直接交给队首的协程
+class FiberSemaphore {
+public:
+    explicit FiberSemaphore(size_t count = 0) : m_count(count) {}
+
+    //P操作，被取消时返回false，errno为取消原因
+    bool wait();
+    bool tryWait();
+    //V操作
+    void signal();
+
+private:
+    SpinLock m_lock;
+    size_t m_count;
+    std::deque<FiberWaiter> m_waiters;
+};
+
+}
+
+#endif
@@ -0,0 +1,89 @@
+#include "future.h"
+
+namespace john {
+
+void FutureStateBase::wait(bool cancellable) {
+    if(isReady()) {
+        return;
+    }
+
+    if(Scheduler::getThis() && Fiber::inFiber()) {
+        CancellableWait cw(m_lock, m_waiters, cancellable);
+        {
+            std::lock_guard<SpinLock> lock(m_lock);
+            if(isReady()) {
+                return;
+            }
+            if(!cw.enqueue()) {
+                set_errno(CancelToken::currentError());
+                return;
+            }
+        }
+        //被唤醒时结果已经就绪，或者被取消
+        Fiber::getThis()->yield();
+        if(cw.cancelled()) {
+            set_errno(CancelToken::currentError());
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<SpinLock> lock(m_lock);
+        if(isReady()) {
+            return;
+        }
+        ++m_threadWaiters;
+    }
+    std::unique_lock<std::mutex> lock(m_threadMutex);
+    m_cond.wait(lock, [this]() {return isReady();});
+}
+
+void FutureStateBase::addCallback(std::function<void()> cb) {
+    {
+        std::lock_guard<SpinLock> lock(m_lock);
+        if(!isReady()) {
+            m_callbacks.push_back(std::move(cb));
+            return;
+        }
+    }
+    cb();
+}
+
+void FutureStateBase::setException(std::exception_ptr error) {
+    m_error = error;
+    complete();
+}
+
+void FutureStateBase::rethrow() const {
+    if(m_error) {
+        std::rethrow_exception(m_error);
+    }
+}
+
+void FutureStateBase::complete() {
+    std::deque<FiberWaiter> waiters;
+    std::vector<std::function<void()>> callbacks;
+    int thread_waiters;
+    {
+        std::lock_guard<SpinLock> lock(m_lock);
+        assert(!isReady());
+        m_ready.store(true, std::memory_order_release);
+        waiters.swap(m_waiters);
+        callbacks.swap(m_callbacks);
+        thread_waiters = m_threadWaiters;
+    }
+
+    for(auto& w : waiters) {
+        w.wake();
+    }
+    //等待者在m_threadMutex下检查m_ready，这里加锁后再通知，不会丢失唤醒
+    if(thread_waiters) {
+        std::lock_guard<std::mutex> lock(m_threadMutex);
+        m_cond.notify_all();
+    }
+    for(auto& cb : callbacks) {
+        cb();
+    }
+}
+
+}
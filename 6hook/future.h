@@ -0,0 +1,276 @@
+#ifndef _FUTURE_H_
+#define _FUTURE_H_
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+#include "fiber_sync.h"
+
+namespace john {
+
+//异步结果的共享状态，由Promise写入、Future读取
+//在调度器的协程中等待时挂起协程，在普通线程中等待时阻塞在条件变量上；
+//完成时唤醒所有等待者，并依次执行注册的回调（在完成结果的线程上执行）
+class FutureStateBase {
+public:
+    virtual ~FutureStateBase() {}
+
+    bool isReady() const {return m_ready.load(std::memory_order_acquire);}
+    //等待结果就绪。cancellable为true时，协程中的等待可以被当前协程的CancelToken取消，
+    //此时返回时结果仍未就绪，errno为取消原因
+    void wait(bool cancellable = true);
+    //结果就绪后执行cb，已经就绪时立即在当前线程执行
+    void addCallback(std::function<void()> cb);
+
+    void setException(std::exception_ptr error);
+    //结果是异常时重新抛出
+    void rethrow() const;
+
+protected:
+    //值已经写入，标记完成并通知等待者。每个状态只能完成一次
+    void complete();
+
+private:
+    SpinLock m_lock;
+    std::atomic<bool> m_ready{false};
+    std::exception_ptr m_error;
+    std::deque<FiberWaiter> m_waiters;
+    std::vector<std::function<void()>> m_callbacks;
+
+    //普通线程的等待
+    int m_threadWaiters = 0;
+    std::mutex m_threadMutex;
+    std::condition_variable m_cond;
+};
+
+template<class T>
+class FutureState : public FutureStateBase {
+public:
+    void setValue(T value) {
+        m_value.emplace(std::move(value));
+        complete();
+    }
+    T& value() {return *m_value;}
+
+private:
+    std::optional<T> m_value;
+};
+
+template<>
+class FutureState<void> : public FutureStateBase {
+public:
+    void setValue() {complete();}
+    void value() {}
+};
+
+template<class T>
+class Future;
+
+namespace detail {
+
+//执行f并把返回值或异常写入state
+template<class T, class F, class... Args>
+void fulfill(FutureState<T>& state, F& f, Args&... args) {
+    try {
+        if constexpr(std::is_void_v<T>) {
+            f(args...);
+            state.setValue();
+        } else {
+            state.setValue(f(args...));
+        }
+    } catch(...) {
+        state.setException(std::current_exception());
+    }
+}
+
+}
+
+//异步结果的读取端，可以拷贝，所有拷贝共享同一个结果
+template<class T>
+class Future {
+public:
+    Future() = default;
+    explicit Future(std::shared_ptr<FutureState<T>> state) : m_state(std::move(state)) {}
+
+    bool valid() const {return m_state != nullptr;}
+    bool isReady() const {return checkedState()->isReady();}
+    void wait() const {checkedState()->wait();}
+
+    //等待并返回结果，结果是异常时重新抛出。返回的是共享状态中的值的引用，需要时可以move走
+    //等待被取消时抛出std::system_error，错误码为取消原因（ECANCELED或ETIMEDOUT）
+    //没有共享状态（默认构造或已被move走）时抛出std::future_error(no_state)
+    decltype(auto) get() const {
+        checkedState()->wait();
+        if(!m_state->isReady()) {
+            throw std::system_error(CancelToken::currentError(), std::generic_category(), "Future::get cancelled");
+        }
+        m_state->rethrow();
+        return m_state->value();
+    }
+
+    //结果就绪后以f(Future<T>)作为新任务放入调度器sc执行，返回f的结果
+    //sc为空时使用调用then的调度器，仍然没有则在完成结果的线程上直接执行
+    template<class F>
+    auto then(F f, Scheduler* sc = nullptr) -> Future<std::invoke_result_t<F&, Future<T>&>> {
+        using R = std::invoke_result_t<F&, Future<T>&>;
+        auto next = std::make_shared<FutureState<R>>();
+        if(!sc) {
+            sc = Scheduler::getThis();
+        }
+
+        Future<T> self = *this;
+        checkedState()->addCallback([self, f, next, sc]() mutable {
+            if(!sc) {
+                detail::fulfill(*next, f, self);
+                return;
+            }
+            sc->schedulerLock(std::function<void()>([self, f, next]() mutable {
+                detail::fulfill(*next, f, self);
+            }));
+        });
+        return Future<R>(next);
+    }
+
+    FutureStateBase* state() const {return m_state.get();}
+
+private:
+    FutureState<T>* checkedState() const {
+        if(!m_state) {
+            throw std::future_error(std::future_errc::no_state);
+        }
+        return m_state.get();
+    }
+
+private:
+    std::shared_ptr<FutureState<T>> m_state;
+};
+
+//异步结果的写入端，只能移动。销毁前没有写入结果时，Future得到broken_promise异常
+template<class T>
+class Promise {
+public:
+    Promise() : m_state(std::make_shared<FutureState<T>>()) {}
+    Promise(Promise&&) = default;
+    Promise& operator=(Promise&& other) {
+        abandon();
+        m_state = std::move(other.m_state);
+        m_satisfied = other.m_satisfied;
+        return *this;
+    }
+    ~Promise() {abandon();}
+
+    Future<T> getFuture() const {
+        if(!m_state) {
+            throw std::future_error(std::future_errc::no_state);
+        }
+        return Future<T>(m_state);
+    }
+
+    //结果只能写入一次，再次写入抛出std::future_error(promise_already_satisfied)，
+    //已被move走的Promise抛出std::future_error(no_state)
+    template<class... Args>
+    void setValue(Args&&... args) {
+        takeState()->setValue(std::forward<Args>(args)...);
+    }
+
+    void setException(std::exception_ptr error) {
+        takeState()->setException(error);
+    }
+
+private:
+    std::shared_ptr<FutureState<T>> takeState() {
+        if(!m_state) {
+            throw std::future_error(m_satisfied ? std::future_errc::promise_already_satisfied : std::future_errc::no_state);
+        }
+        m_satisfied = true;
+        return std::move(m_state);
+    }
+
+    void abandon() {
+        if(m_state && !m_state->isReady()) {
+            m_state->setException(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+        }
+    }
+
+private:
+    std::shared_ptr<FutureState<T>> m_state;
+    bool m_satisfied = false; //结果已经写入，m_state随之交出
+};
+
+//把f放入调度器执行，返回f的结果
+template<class F>
+auto submit(Scheduler* sc, F f, int thread = -1) -> Future<std::invoke_result_t<F&>> {
+    using R = std::invoke_result_t<F&>;
+    auto state = std::make_shared<FutureState<R>>();
+    sc->schedulerLock(std::function<void()>([state, f]() mutable {
+        detail::fulfill(*state, f);
+    }), thread);
+    return Future<R>(state);
+}
+
+//when_all/when_any不接受没有共享状态的future（默认构造或已被move走），在注册任何回调前抛出std::future_error
+template<class T>
+void check_futures(const std::vector<Future<T>>& futures) {
+    for(auto& f : futures) {
+        if(!f.valid()) {
+            throw std::future_error(std::future_errc::no_state);
+        }
+    }
+}
+
+//所有future都就绪后完成，结果是传入的future本身，各自的值或异常通过get取得
+template<class T>
+Future<std::vector<Future<T>>> when_all(std::vector<Future<T>> futures) {
+    check_futures(futures);
+    auto state = std::make_shared<FutureState<std::vector<Future<T>>>>();
+    if(futures.empty()) {
+        state->setValue(std::move(futures));
+        return Future<std::vector<Future<T>>>(state);
+    }
+
+    //最后一个完成的future负责写入结果；vector放在共享对象里，回调执行时它一定还活着
+    struct Context {
+        std::vector<Future<T>> futures;
+        std::atomic<size_t> remaining;
+    };
+    auto ctx = std::make_shared<Context>();
+    ctx->futures = std::move(futures);
+    ctx->remaining = ctx->futures.size();
+    for(auto& f : ctx->futures) {
+        f.state()->addCallback([ctx, state]() {
+            if(--ctx->remaining == 0) {
+                state->setValue(std::move(ctx->futures));
+            }
+        });
+    }
+    return Future<std::vector<Future<T>>>(state);
+}
+
+//任一future就绪后完成，结果是它在futures中的下标；futures为空时永远不会完成
+template<class T>
+Future<size_t> when_any(const std::vector<Future<T>>& futures) {
+    check_futures(futures);
+    auto state = std::make_shared<FutureState<size_t>>();
+    auto done = std::make_shared<std::atomic<bool>>(false);
+    for(size_t i = 0; i < futures.size(); ++i) {
+        futures[i].state()->addCallback([state, done, i]() {
+            if(!done->exchange(true)) {
+                state->setValue(i);
+            }
+        });
+    }
+    return Future<size_t>(state);
+}
+
+}
+
+#endif
@@ -4,7 +4,13 @@
 #include <iostream>
 #include <cstdarg>
 #include "fd_manager.h"
+#include "cancel.h"
 #include <string.h>
+#include <chrono>
+#include <vector>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <netinet/udp.h>
 
 // apply XX to all functions
 #define HOOK_FUN(XX) \
@@ -14,21 +20,41 @@
     XX(socket) \
     XX(connect) \
     XX(accept) \
+    XX(accept4) \
+    XX(socketpair) \
     XX(read) \
     XX(readv) \
+    XX(pread) \
     XX(recv) \
     XX(recvfrom) \
     XX(recvmsg) \
+    XX(recvmmsg) \
     XX(write) \
     XX(writev) \
+    XX(pwrite) \
+    XX(fsync) \
     XX(send) \
     XX(sendto) \
     XX(sendmsg) \
+    XX(sendmmsg) \
+    XX(sendfile) \
+    XX(splice) \
+    XX(tee) \
     XX(close) \
+    XX(dup) \
+    XX(dup2) \
+    XX(dup3) \
+    XX(pipe) \
+    XX(pipe2) \
+    XX(eventfd) \
     XX(fcntl) \
     XX(ioctl) \
     XX(getsockopt) \
-    XX(setsockopt) 
+    XX(setsockopt) \
+    XX(poll) \
+    XX(ppoll) \
+    XX(select) \
+    XX(epoll_wait)
 
 //匿名空间john中实现hook函数的初始化，提供是否启动hook的函数
 namespace john {
@@ -83,16 +109,64 @@ static HookIniter s_hook_initer;
 } //end namespace john
 
 
+// 定义JOHN_NO_HOOK时不编译任何同名的hook函数，所有调用直接进入libc，见hook.h
+#ifndef JOHN_NO_HOOK
+
 //该结构的成员变量表示定时器是否被取消，用于跟踪定时器状态信息
+//定时器回调运行在其他线程上，因此使用原子变量
 struct timer_info 
 {
-    int cancelled = 0;
+    std::atomic<int> cancelled{0};
 };
 
+// 当前协程的截止时间（with_deadline）在timeout_ms之内到达时返回true，
+// 这时超时由截止时间的定时器通过取消令牌负责，本次调用不需要再设置自己的定时器
+static bool deadline_covers(uint64_t timeout_ms)
+{
+    john::CancelToken* token = john::CancelToken::current();
+    if(!token || token->deadline() == std::chrono::steady_clock::time_point::max())
+    {
+        return false;
+    }
+    auto left = std::chrono::ceil<std::chrono::milliseconds>(token->deadline() - std::chrono::steady_clock::now()).count();
+    return left <= 0 || (uint64_t)left <= timeout_ms;
+}
+
+// 普通文件的 I/O 操作：epoll 无法等待普通文件，直接调用会阻塞整个工作线程
+// 因此把系统调用交给阻塞IO线程池执行，当前协程挂起，完成后由线程池把协程放回调度器
+template<typename OriginFun, typename... Args>
+static ssize_t do_blocking_io(int fd, OriginFun fun, Args&&... args)
+{
+    john::IOManager* iom = john::IOManager::getThis();
+    if(!iom || !john::Fiber::inFiber())
+    {
+        // 不在调度器中，或者当前是线程的主协程/调度协程，没有可以挂起后再被调度回来的协程，直接调用原始函数
+        return fun(fd, std::forward<Args>(args)...);
+    }
+
+    std::shared_ptr<john::Fiber> fiber = john::Fiber::getThis();
+    ssize_t n = -1;
+    int err = 0;
+
+    // 参数都在当前协程栈上，协程被重新调度前不会返回，因此可以按引用捕获
+    iom->submitBlocking([&]() 
+    {
+        n = fun(fd, args...);
+        err = errno;
+        iom->schedulerLock(fiber);
+    });
+
+    // 挂起当前协程，等待线程池完成操作
+    fiber->yield();
+
+    john::set_errno(err);
+    return n;
+}
+
 // 通用的 I/O 操作函数模板
 //将 I/O 操作包装起来，增加了超时和事件处理逻辑，使得能够在非阻塞模式下有效地处理 I/O 操作
 template<typename OriginFun, typename... Args>
-static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name, uint32_t event, int timeout_so, Args&&... args) 
+static ssize_t do_io(int fd, OriginFun fun, uint32_t event, int timeout_so, Args&&... args) 
 {
     // 检查是否启用hook，如果没有，直接调用原始的 I/O 函数
     if(!john::t_hook_enable) 
@@ -101,7 +175,8 @@ static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name, uint32_t
     }
 
     // 获取文件描述符的上下文（FdCtx），获取文件描述符相关的状态信息
-    std::shared_ptr<john::FdCtx> ctx = john::FdMgr::GetInstance()->get(fd);
+    // 不存在时创建上下文，这样通过open等未hook接口得到的普通文件也能被识别出来
+    std::shared_ptr<john::FdCtx> ctx = john::FdMgr::GetInstance()->get(fd, true);
     if(!ctx) 
     {
         // 如果无法获取上下文，直接调用原始 I/O 函数
@@ -115,8 +190,14 @@ static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name, uint32_t
         return -1;
     }
 
-    // 如果不是套接字或用户设置了非阻塞模式，直接调用原始 I/O 函数
-    if(!ctx->isSocket() || ctx->getUserNonblock()) 
+    // 普通文件交给阻塞IO线程池，避免阻塞工作线程
+    if(ctx->isRegularFile()) 
+    {
+        return do_blocking_io(fd, fun, std::forward<Args>(args)...);
+    }
+
+    // 如果不能交给 epoll 等待或用户设置了非阻塞模式，直接调用原始 I/O 函数
+    if(!ctx->isPollable() || ctx->getUserNonblock()) 
     {
         return fun(fd, std::forward<Args>(args)...);
     }
@@ -126,6 +207,8 @@ static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name, uint32_t
 
     // 创建一个 shared_ptr 用于保存定时器状态信息
     std::shared_ptr<timer_info> tinfo(new timer_info);
+    // 本次调用的超时定时器，所有重试共用
+    std::shared_ptr<john::Timer> timer;
 
 //1.处理系统调用被中断（EINTR）的情况，必要时重试。
 retry:
@@ -143,17 +226,14 @@ retry:
     if(n == -1 && errno == EAGAIN) 
     {
         john::IOManager* iom = john::IOManager::getThis();
-        
-        std::shared_ptr<john::Timer> timer;
-        
-        std::weak_ptr<timer_info> winfo(tinfo); //弱指针防止循环引用
 
         //-1可以看作“无限”或“未设置”的特殊值。不等于-1表示设置了超时值，需要进一步处理。
-        //在连接操作超时的情况下设置一个定时器，并设置回调函数：如果超时发生，就取消写事件，从而避免无限等待连接而阻塞。
-        if(timeout != (uint64_t)-1) 
+        //超时是针对整个调用的截止时间：定时器只在第一次EAGAIN时设置，之后的重试沿用同一个定时器，
+        //这样数据断断续续到达也不会把超时一再延长，每次调用的定时器开销也固定为一次添加、一次取消
+        if(timeout != (uint64_t)-1 && !timer && !deadline_covers(timeout)) 
         {
+            std::weak_ptr<timer_info> winfo(tinfo); //弱指针防止循环引用
             //如果设置了超时值，定时器会在超时后触发回调函数，再执行取消操作
-            //[winfo, fd, iom, event]() {...}这是一个lambda表达式，{...}其中是回调函数内容
             timer = iom->addConidtionTimer(timeout, [winfo, fd, iom, event]() 
             {
                 //通过lock获取对应的shared_ptr，如果共享指针被销毁则返回nullptr，所以需要检查返回值是否有效
@@ -163,54 +243,350 @@ retry:
                 {
                     return; 
                 }
-                //如果定时器未取消，标记为超时错误状态，并通知 IO 管理器取消写事件
+                //如果定时器未取消，标记为超时错误状态，并通知 IO 管理器取消事件，唤醒等待中的协程
                 t->cancelled = ETIMEDOUT;
-                //连接操作在此时仍未完成，IO 管理器将不会再处理该文件描述符的写事件，从而防止继续等待连接完成。
                 iom->cancelEvent(fd, (john::IOManager::Event)(event));
-            }, winfo); //指向定时器的关联信息。weak_ptr 是用来防止循环引用的智能指针，它不会阻止 timer_info 对象被销毁。
+            }, winfo);
+        }
+
+        // 当前协程的取消令牌被取消时，记录取消原因并取消事件，唤醒等待中的协程
+        john::CancelToken* token = john::CancelToken::current();
+        john::CancelRegistration cancel_reg;
+        if(!cancel_reg.reset(token, [tinfo, fd, iom, event, token]() 
+        {
+            int expected = 0;
+            if(tinfo->cancelled.compare_exchange_strong(expected, token->error())) 
+            {
+                iom->cancelEvent(fd, (john::IOManager::Event)(event));
+            }
+        })) 
+        {
+            tinfo->cancelled = token->error();
+        }
+
+        // 超时或取消可能在两次等待之间到达，此时没有注册的事件可以取消，需要在这里直接返回
+        if(tinfo->cancelled) 
+        {
+            if(timer) 
+            {
+                timer->cancel();
+            }
+            john::set_errno(tinfo->cancelled);
+            return -1;
         }
 
-        //未设置超时值，则是IO操作未完成需要等待
         // 3.（关键）将当前事件添加到 I/O 管理器中，进行事件注册
         int rt = iom->addEvent(fd, (john::IOManager::Event)(event));
         
         if(rt) 
         {
-            // 如果事件添加失败，打印错误信息并取消定时器
-            std::cout << hook_fun_name << " addEvent("<< fd << ", " << event << ")";
+            // 事件添加失败（fd 上同一事件已有其他协程在等待），取消定时器并以 EBUSY 返回
             if(timer) 
             {
                 timer->cancel(); // 取消定时器
             }
+            john::set_errno(EBUSY);
             return -1; // 返回错误
         } 
-        else // 添加事件成功
+
+        // 定时器或取消可能恰好在检查之后、注册事件之前触发，这时由自己取消事件，保证协程能被唤醒
+        if(tinfo->cancelled) 
         {
-            // 挂起当前协程，等待事件完成
-            john::Fiber::getThis()->yield();
+            iom->cancelEvent(fd, (john::IOManager::Event)(event));
+        }
+
+        // 挂起当前协程，等待事件完成
+        john::Fiber::getThis()->yield();
 
-            // 等待完成后取消定时器
+        // 如果超时或取消被触发，设置 errno 并返回错误
+        if(tinfo->cancelled) 
+        {
             if(timer) 
             {
                 timer->cancel();
             }
-            
-            // 如果超时被触发，设置 errno 并返回错误
-            if(tinfo->cancelled == ETIMEDOUT) 
+            john::set_errno(tinfo->cancelled);
+            return -1;
+        }
+
+        // 重新尝试执行 I/O 操作
+        goto retry;
+    }
+
+    // 整个调用结束后再取消定时器
+    if(timer) 
+    {
+        timer->cancel();
+    }
+
+    // 返回 I/O 操作的结果
+    return n;
+}
+
+// poll 系列 hook 的公共实现
+// 把每个 fd 关注的读写事件注册到 IOManager，并设置一个超时定时器，
+// 所有事件共享同一个唤醒状态，保证协程只会被调度一次
+struct poll_state 
+{
+    explicit poll_state(size_t n) : ran(n) {}
+
+    std::atomic<bool> fired{false};
+    std::atomic<bool> cancelled{false};
+    std::vector<std::atomic<bool>> ran; // 每个注册的事件的回调是否已经运行，运行过的注册不能再删除
+};
+
+// 事件注册冲突时重试的间隔
+static const int POLL_RETRY_MS = 1;
+
+static int do_poll(struct pollfd* fds, nfds_t nfds, int timeout_ms)
+{
+    // 先非阻塞地检查一次，已经有就绪的 fd 或者不需要等待时直接返回
+    int n = poll_f(fds, nfds, 0);
+    if(n != 0 || timeout_ms == 0) 
+    {
+        return n;
+    }
+
+    john::IOManager* iom = john::IOManager::getThis();
+    if(!iom) 
+    {
+        return poll_f(fds, nfds, timeout_ms);
+    }
+
+    // 负数超时表示无限等待
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+    while(true) 
+    {
+        int remain_ms = -1;
+        if(timeout_ms > 0) 
+        {
+            auto remain = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            remain_ms = remain.count() > 0 ? remain.count() : 0;
+        }
+
+        std::shared_ptr<john::Fiber> fiber = john::Fiber::getThis();
+        std::shared_ptr<poll_state> state(new poll_state(nfds * 2));
+        // 任一事件或定时器先触发都会调用 wake，只有第一次调用会重新调度协程
+        auto wake = [state, fiber, iom]() 
+        {
+            if(!state->fired.exchange(true)) 
+            {
+                iom->schedulerLock(fiber);
+            }
+        };
+
+        // 当前协程的取消令牌被取消时同样唤醒协程
+        john::CancelRegistration cancel_reg;
+        if(!cancel_reg.reset(john::CancelToken::current(), [state, wake]() 
+        {
+            state->cancelled = true;
+            wake();
+        })) 
+        {
+            john::set_errno(john::CancelToken::currentError());
+            return -1;
+        }
+
+        // 1.注册所有关注的事件，同一个 fd 的同一事件只注册一次
+        std::vector<std::pair<int, john::IOManager::Event>> added;
+        bool failed = false;
+        for(nfds_t i = 0; i < nfds && !failed; ++i) 
+        {
+            if(fds[i].fd < 0) 
+            {
+                continue;
+            }
+            int want[2] = {0, 0};
+            if(fds[i].events & (POLLIN | POLLPRI | POLLRDNORM | POLLRDBAND)) 
+            {
+                want[0] = john::IOManager::READ;
+            }
+            if(fds[i].events & (POLLOUT | POLLWRNORM | POLLWRBAND)) 
+            {
+                want[1] = john::IOManager::WRITE;
+            }
+            for(int e : want) 
+            {
+                if(!e) 
+                {
+                    continue;
+                }
+                std::pair<int, john::IOManager::Event> key(fds[i].fd, (john::IOManager::Event)e);
+                bool dup = false;
+                for(auto& a : added) 
+                {
+                    dup = dup || (a == key);
+                }
+                if(dup) 
+                {
+                    continue;
+                }
+                size_t index = added.size();
+                auto on_event = [state, index, wake]() 
+                {
+                    state->ran[index] = true;
+                    wake();
+                };
+                // 以 state 作为注册的标识，回调排队期间同一 fd 上的新注册不会被误删
+                if(iom->addEvent(key.first, key.second, on_event, state.get())) 
+                {
+                    failed = true;
+                    break;
+                }
+                added.push_back(key);
+            }
+        }
+
+        // 注册失败（比如 fd 上已有其他协程在等待同一事件）：先抑制已注册事件的唤醒再撤销它们，
+        // 然后非阻塞地检查一次，未就绪时睡眠一小段时间后重试，睡眠可以被取消
+        if(failed) 
+        {
+            state->fired = true;
+            for(size_t i = 0; i < added.size(); ++i) 
+            {
+                if(!state->ran[i]) 
+                {
+                    iom->delEvent(added[i].first, added[i].second, state.get());
+                }
+            }
+            n = poll_f(fds, nfds, 0);
+            if(n != 0 || remain_ms == 0) 
+            {
+                return n;
+            }
+            int retry_ms = remain_ms > 0 ? std::min(remain_ms, POLL_RETRY_MS) : POLL_RETRY_MS;
+            if(!iom->sleepFor(std::chrono::milliseconds(retry_ms))) 
             {
-                errno = tinfo->cancelled;
                 return -1;
             }
-            
-            // 重新尝试执行 I/O 操作
-            goto retry;
+            continue;
+        }
+
+        // 2.设置超时定时器
+        std::shared_ptr<john::Timer> timer;
+        if(remain_ms >= 0) 
+        {
+            timer = iom->addTimer(remain_ms, wake);
+        }
+
+        // 3.挂起协程，等待任一事件就绪或超时
+        fiber->yield();
+
+        // 4.撤销其余仍在等待的事件和定时器
+        if(timer) 
+        {
+            timer->cancel();
+        }
+        for(size_t i = 0; i < added.size(); ++i) 
+        {
+            if(!state->ran[i]) 
+            {
+                iom->delEvent(added[i].first, added[i].second, state.get());
+            }
+        }
+        if(state->cancelled) 
+        {
+            john::set_errno(john::CancelToken::currentError());
+            return -1;
+        }
+
+        // 5.再非阻塞地检查一次，得到真正的 revents
+        n = poll_f(fds, nfds, 0);
+        if(n != 0) 
+        {
+            return n;
+        }
+        if(timeout_ms > 0 && std::chrono::steady_clock::now() >= deadline) 
+        {
+            return 0;
         }
     }
+}
 
-    // 返回 I/O 操作的结果
-    return n;
+// splice/tee 的两端都可能未就绪，EAGAIN 时同时等待由 hook 管理的输入端可读和输出端可写
+template<typename Fun>
+static ssize_t do_splice(int fd_in, int fd_out, unsigned int flags, Fun fun)
+{
+	if(!john::t_hook_enable || (flags & SPLICE_F_NONBLOCK))
+	{
+		return fun();
+	}
+
+	std::shared_ptr<john::FdCtx> in = john::FdMgr::GetInstance()->get(fd_in);
+	std::shared_ptr<john::FdCtx> out = john::FdMgr::GetInstance()->get(fd_out);
+	if((in && in->getUserNonblock()) || (out && out->getUserNonblock()))
+	{
+		return fun();
+	}
+
+	struct pollfd pfds[2];
+	nfds_t nfds = 0;
+	uint64_t timeout = (uint64_t)-1;
+	if(in && in->isPollable())
+	{
+		pfds[nfds++] = {fd_in, POLLIN, 0};
+		timeout = in->getTimeout(SO_RCVTIMEO);
+	}
+	if(out && out->isPollable())
+	{
+		pfds[nfds++] = {fd_out, POLLOUT, 0};
+		timeout = std::min(timeout, out->getTimeout(SO_SNDTIMEO));
+	}
+
+	// 超时是整个调用的截止时间，多次等待之间不重新计时
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+	while(true)
+	{
+		ssize_t n = fun();
+		if(n == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if(n != -1 || errno != EAGAIN || nfds == 0)
+		{
+			return n;
+		}
+
+		int remain_ms = -1;
+		if(timeout != (uint64_t)-1)
+		{
+			auto remain = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+			remain_ms = remain.count() > 0 ? remain.count() : 0;
+		}
+		// 只等待尚未就绪的一端，已经就绪的一端会让 poll 立即返回，变成忙等
+		struct pollfd waits[2];
+		nfds_t nwaits = 0;
+		poll_f(pfds, nfds, 0);
+		for(nfds_t i = 0; i < nfds; ++i)
+		{
+			if(!(pfds[i].revents & (pfds[i].events | POLLERR | POLLHUP)))
+			{
+				waits[nwaits++] = pfds[i];
+			}
+		}
+		// 两端都就绪却仍然返回 EAGAIN，只能让出一小段时间后重试
+		if(nwaits == 0)
+		{
+			usleep(50);
+			continue;
+		}
+
+		int rt = do_poll(waits, nwaits, remain_ms);
+		if(rt < 0)
+		{
+			return -1;
+		}
+		if(rt == 0)
+		{
+			john::set_errno(ETIMEDOUT);
+			return -1;
+		}
+	}
 }
 
+#endif // JOHN_NO_HOOK
+
 extern "C" {
 
 // declaration -> sleep_fun sleep_f = nullptr;
@@ -218,56 +594,71 @@ extern "C" {
 	HOOK_FUN(XX)
 #undef XX
 
+#ifndef JOHN_NO_HOOK
+
 //sleep hook封装
 // only use at task fiber
+// 休眠的协程直接挂到定时器的最小堆上，到期后由idle协程重新调度，不分配Timer和回调
 unsigned int sleep(unsigned int seconds)
 {
-	if(!john::t_hook_enable)
+	john::IOManager* iom = john::IOManager::getThis();
+	if(!john::t_hook_enable || !iom)
 	{
 		return sleep_f(seconds);
 	}
 
-	std::shared_ptr<john::Fiber> fiber = john::Fiber::getThis();
-	john::IOManager* iom = john::IOManager::getThis();
-	// add a timer to reschedule this fiber
-	iom->addTimer(seconds*1000, [fiber, iom](){iom->schedulerLock(fiber, -1);});
-	// wait for the next resume
-	fiber->yield();
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+	if(!iom->sleepUntil(deadline))
+	{
+		// 被取消时按sleep的约定返回没有睡完的秒数
+		auto remain = std::chrono::ceil<std::chrono::seconds>(deadline - std::chrono::steady_clock::now());
+		return remain.count() > 0 ? remain.count() : 0;
+	}
 	return 0;
 }
 
 int usleep(useconds_t usec)
 {
-	if(!john::t_hook_enable)
+	john::IOManager* iom = john::IOManager::getThis();
+	if(!john::t_hook_enable || !iom)
 	{
 		return usleep_f(usec);
 	}
 
-	std::shared_ptr<john::Fiber> fiber = john::Fiber::getThis();
-	john::IOManager* iom = john::IOManager::getThis();
-	// add a timer to reschedule this fiber
-	iom->addTimer(usec/1000, [fiber, iom](){iom->schedulerLock(fiber);});
-	// wait for the next resume
-	fiber->yield();
+	if(!iom->sleepFor(std::chrono::microseconds(usec)))
+	{
+		return -1;
+	}
 	return 0;
 }
 
 int nanosleep(const struct timespec* req, struct timespec* rem)
 {
-	if(!john::t_hook_enable)
+	john::IOManager* iom = john::IOManager::getThis();
+	if(!john::t_hook_enable || !iom)
 	{
 		return nanosleep_f(req, rem);
 	}	
 
-	int timeout_ms = req->tv_sec*1000 + req->tv_nsec/1000/1000;
+	if(req->tv_nsec < 0 || req->tv_nsec >= 1000000000 || req->tv_sec < 0)
+	{
+		errno = EINVAL;
+		return -1;
+	}
 
-	std::shared_ptr<john::Fiber> fiber = john::Fiber::getThis();
-	john::IOManager* iom = john::IOManager::getThis();
-	// add a timer to reschedule this fiber
-	iom->addTimer(timeout_ms, [fiber, iom](){iom->schedulerLock(fiber, -1);});
-	// wait for the next resume
-	fiber->yield();	
-	return 0;
+	// 不足一微秒的部分向上取整，保证不会提前醒来
+	auto duration = std::chrono::seconds(req->tv_sec) + std::chrono::microseconds((req->tv_nsec + 999) / 1000);
+	auto deadline = std::chrono::steady_clock::now() + duration;
+	bool done = iom->sleepUntil(deadline);
+	// 协程休眠不会被信号打断，只有被取消时剩余时间才不为0
+	if(rem)
+	{
+		auto remain = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - std::chrono::steady_clock::now());
+		long long ns = done || remain.count() < 0 ? 0 : remain.count();
+		rem->tv_sec = ns / 1000000000;
+		rem->tv_nsec = ns % 1000000000;
+	}
+	return done ? 0 : -1;
 }
 
 //socket hook封装
@@ -278,16 +669,34 @@ int socket(int domain, int type, int protocol)
 		return socket_f(domain, type, protocol);
 	}	
 
-	int fd = socket_f(domain, type, protocol);
+	// 直接创建非阻塞socket，省去FdCtx::init中的fstat和fcntl
+	int fd = socket_f(domain, type | SOCK_NONBLOCK, protocol);
 	if(fd==-1)
 	{
 		std::cerr << "socket() failed:" << strerror(errno) << std::endl;
 		return fd;
 	}
-	john::FdMgr::GetInstance()->get(fd, true);
+	// 新创建的fd可能复用了旧fd的编号，直接覆盖旧的上下文
+	john::FdMgr::GetInstance()->add(fd, true, type & SOCK_NONBLOCK);
 	return fd;
 }
 
+int socketpair(int domain, int type, int protocol, int sv[2])
+{
+	if(!john::t_hook_enable)
+	{
+		return socketpair_f(domain, type, protocol, sv);
+	}
+
+	int rt = socketpair_f(domain, type | SOCK_NONBLOCK, protocol, sv);
+	if(rt==0)
+	{
+		john::FdMgr::GetInstance()->add(sv[0], true, type & SOCK_NONBLOCK);
+		john::FdMgr::GetInstance()->add(sv[1], true, type & SOCK_NONBLOCK);
+	}
+	return rt;
+}
+
 // 超时情况下的非阻塞套接字连接
 int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen, uint64_t timeout_ms) 
 {
@@ -345,7 +754,8 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
     std::weak_ptr<timer_info> winfo(tinfo);
 
     // 如果设置了超时时间（timeout_ms），则启动定时器
-    if (timeout_ms != (uint64_t)-1) 
+    // 协程的截止时间更早时由它的定时器负责超时，不再单独设置
+    if (timeout_ms != (uint64_t)-1 && !deadline_covers(timeout_ms)) 
     {
         timer = iom->addConidtionTimer(timeout_ms, [winfo, fd, iom]() 
         {
@@ -361,10 +771,31 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
         }, winfo);
     }
 
+    // 当前协程的取消令牌被取消时，与超时一样取消写事件并唤醒协程
+    john::CancelToken* token = john::CancelToken::current();
+    john::CancelRegistration cancel_reg;
+    if (!cancel_reg.reset(token, [tinfo, fd, iom, token]() 
+    {
+        int expected = 0;
+        if (tinfo->cancelled.compare_exchange_strong(expected, token->error())) 
+        {
+            iom->cancelEvent(fd, john::IOManager::WRITE);
+        }
+    })) 
+    {
+        tinfo->cancelled = token->error();
+    }
+
     // 将套接字 fd 注册到 IO 管理器的写事件中，等待连接完成
     int rt = iom->addEvent(fd, john::IOManager::WRITE);
     if (rt == 0) 
     {
+        // 超时或取消可能发生在注册事件之前，此时由自己取消事件
+        if (tinfo->cancelled) 
+        {
+            iom->cancelEvent(fd, john::IOManager::WRITE);
+        }
+
         // 如果事件成功注册，则将当前协程挂起（yield），等待事件通知
         john::Fiber::getThis()->yield();
 
@@ -374,10 +805,10 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
             timer->cancel();
         }
 
-        // 如果定时器已被取消，说明是超时导致的，设置 errno 为超时错误
+        // 超时或被取消，设置对应的 errno
         if (tinfo->cancelled) 
         {
-            errno = tinfo->cancelled;
+            john::set_errno(tinfo->cancelled);
             return -1;
         }
     } 
@@ -409,7 +840,7 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
     // 如果发生了其他错误，将 errno 设置为该错误，并返回 -1
     else 
     {
-        errno = error;
+        john::set_errno(error);
         return -1;
     }
 }
@@ -424,71 +855,125 @@ int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen)
 
 int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen)
 {
-	int fd = do_io(sockfd, accept_f, "accept", john::IOManager::READ, SO_RCVTIMEO, addr, addrlen);	
+	return accept4(sockfd, addr, addrlen, 0);
+}
+
+int accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags)
+{
+	if(!john::t_hook_enable)
+	{
+		return accept4_f(sockfd, addr, addrlen, flags);
+	}
+
+	// 直接以SOCK_NONBLOCK接收连接，新fd无需再经过FdCtx::init中的fstat和fcntl
+	int fd = do_io(sockfd, accept4_f, john::IOManager::READ, SO_RCVTIMEO, addr, addrlen, flags | SOCK_NONBLOCK);	
 	if(fd>=0)
 	{
-		john::FdMgr::GetInstance()->get(fd, true);
+		john::FdMgr::GetInstance()->add(fd, true, flags & SOCK_NONBLOCK);
 	}
 	return fd;
 }
 
 ssize_t read(int fd, void *buf, size_t count)
 {
-	return do_io(fd, read_f, "read", john::IOManager::READ, SO_RCVTIMEO, buf, count);	
+	return do_io(fd, read_f, john::IOManager::READ, SO_RCVTIMEO, buf, count);	
 }
 
 ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
 {
-	return do_io(fd, readv_f, "readv", john::IOManager::READ, SO_RCVTIMEO, iov, iovcnt);	
+	return do_io(fd, readv_f, john::IOManager::READ, SO_RCVTIMEO, iov, iovcnt);	
+}
+
+ssize_t pread(int fd, void *buf, size_t count, off_t offset)
+{
+	return do_io(fd, pread_f, john::IOManager::READ, SO_RCVTIMEO, buf, count, offset);	
 }
 
 ssize_t recv(int sockfd, void *buf, size_t len, int flags)
 {
-	return do_io(sockfd, recv_f, "recv", john::IOManager::READ, SO_RCVTIMEO, buf, len, flags);	
+	return do_io(sockfd, recv_f, john::IOManager::READ, SO_RCVTIMEO, buf, len, flags);	
 }
 
 ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen)
 {
-	return do_io(sockfd, recvfrom_f, "recvfrom", john::IOManager::READ, SO_RCVTIMEO, buf, len, flags, src_addr, addrlen);	
+	return do_io(sockfd, recvfrom_f, john::IOManager::READ, SO_RCVTIMEO, buf, len, flags, src_addr, addrlen);	
 }
 
 ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags)
 {
-	return do_io(sockfd, recvmsg_f, "recvmsg", john::IOManager::READ, SO_RCVTIMEO, msg, flags);	
+	return do_io(sockfd, recvmsg_f, john::IOManager::READ, SO_RCVTIMEO, msg, flags);	
+}
+
+// socket 已是非阻塞的，一次唤醒后 recvmmsg 会取走当前已到达的全部数据报，而不是每个数据报唤醒一次
+int recvmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags, struct timespec *timeout)
+{
+	return do_io(sockfd, recvmmsg_f, john::IOManager::READ, SO_RCVTIMEO, msgvec, vlen, flags, timeout);
 }
 
 ssize_t write(int fd, const void *buf, size_t count)
 {
-	return do_io(fd, write_f, "write", john::IOManager::WRITE, SO_SNDTIMEO, buf, count);	
+	return do_io(fd, write_f, john::IOManager::WRITE, SO_SNDTIMEO, buf, count);	
 }
 
 ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
 {
-	return do_io(fd, writev_f, "writev", john::IOManager::WRITE, SO_SNDTIMEO, iov, iovcnt);	
+	return do_io(fd, writev_f, john::IOManager::WRITE, SO_SNDTIMEO, iov, iovcnt);	
+}
+
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset)
+{
+	return do_io(fd, pwrite_f, john::IOManager::WRITE, SO_SNDTIMEO, buf, count, offset);	
+}
+
+int fsync(int fd)
+{
+	return do_io(fd, fsync_f, john::IOManager::WRITE, SO_SNDTIMEO);	
 }
 
 ssize_t send(int sockfd, const void *buf, size_t len, int flags)
 {
-	return do_io(sockfd, send_f, "send", john::IOManager::WRITE, SO_SNDTIMEO, buf, len, flags);	
+	return do_io(sockfd, send_f, john::IOManager::WRITE, SO_SNDTIMEO, buf, len, flags);	
 }
 
 ssize_t sendto(int sockfd, const void *buf, size_t len, int flags, const struct sockaddr *dest_addr, socklen_t addrlen)
 {
-	return do_io(sockfd, sendto_f, "sendto", john::IOManager::WRITE, SO_SNDTIMEO, buf, len, flags, dest_addr, addrlen);	
+	return do_io(sockfd, sendto_f, john::IOManager::WRITE, SO_SNDTIMEO, buf, len, flags, dest_addr, addrlen);	
 }
 
 ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags)
 {
-	return do_io(sockfd, sendmsg_f, "sendmsg", john::IOManager::WRITE, SO_SNDTIMEO, msg, flags);	
+	return do_io(sockfd, sendmsg_f, john::IOManager::WRITE, SO_SNDTIMEO, msg, flags);	
 }
 
-int close(int fd)
+int sendmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags)
 {
-	if(!john::t_hook_enable)
+	return do_io(sockfd, sendmmsg_f, john::IOManager::WRITE, SO_SNDTIMEO, msgvec, vlen, flags);
+}
+
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count)
+{
+	return do_io(out_fd, sendfile_f, john::IOManager::WRITE, SO_SNDTIMEO, in_fd, offset, count);
+}
+
+ssize_t splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len, unsigned int flags)
+{
+	return do_splice(fd_in, fd_out, flags, [=]() 
 	{
-		return close_f(fd);
-	}	
+		return splice_f(fd_in, off_in, fd_out, off_out, len, flags);
+	});
+}
 
+ssize_t tee(int fd_in, int fd_out, size_t len, unsigned int flags)
+{
+	return do_splice(fd_in, fd_out, flags, [=]() 
+	{
+		return tee_f(fd_in, fd_out, len, flags);
+	});
+}
+
+// fd 被关闭或被 dup2 覆盖前，唤醒其上等待的协程并删除上下文
+static void release_fd(int fd)
+{
 	std::shared_ptr<john::FdCtx> ctx = john::FdMgr::GetInstance()->get(fd);
 
 	if(ctx)
@@ -501,9 +986,99 @@ int close(int fd)
 		// del fdctx
 		john::FdMgr::GetInstance()->del(fd);
 	}
+}
+
+int close(int fd)
+{
+	if(!john::t_hook_enable)
+	{
+		return close_f(fd);
+	}	
+
+	release_fd(fd);
 	return close_f(fd);
 }
 
+int dup(int oldfd)
+{
+	int newfd = dup_f(oldfd);
+	if(john::t_hook_enable && newfd >= 0)
+	{
+		john::FdMgr::GetInstance()->dup(oldfd, newfd);
+	}
+	return newfd;
+}
+
+int dup2(int oldfd, int newfd)
+{
+	if(!john::t_hook_enable || oldfd == newfd)
+	{
+		return dup2_f(oldfd, newfd);
+	}
+
+	// dup2 会隐式关闭 newfd，和 close 一样先处理旧的上下文
+	release_fd(newfd);
+	int rt = dup2_f(oldfd, newfd);
+	if(rt >= 0)
+	{
+		john::FdMgr::GetInstance()->dup(oldfd, newfd);
+	}
+	return rt;
+}
+
+int dup3(int oldfd, int newfd, int flags)
+{
+	if(!john::t_hook_enable || oldfd == newfd)
+	{
+		return dup3_f(oldfd, newfd, flags);
+	}
+
+	release_fd(newfd);
+	int rt = dup3_f(oldfd, newfd, flags);
+	if(rt >= 0)
+	{
+		john::FdMgr::GetInstance()->dup(oldfd, newfd);
+	}
+	return rt;
+}
+
+int pipe(int pipefd[2])
+{
+	return pipe2(pipefd, 0);
+}
+
+// hook 创建的管道设为非阻塞，读写时和 socket 一样挂起协程而不是阻塞线程
+int pipe2(int pipefd[2], int flags)
+{
+	if(!john::t_hook_enable)
+	{
+		return pipe2_f(pipefd, flags);
+	}
+
+	int rt = pipe2_f(pipefd, flags | O_NONBLOCK);
+	if(rt == 0)
+	{
+		john::FdMgr::GetInstance()->add(pipefd[0], false, flags & O_NONBLOCK);
+		john::FdMgr::GetInstance()->add(pipefd[1], false, flags & O_NONBLOCK);
+	}
+	return rt;
+}
+
+int eventfd(unsigned int initval, int flags)
+{
+	if(!john::t_hook_enable)
+	{
+		return eventfd_f(initval, flags);
+	}
+
+	int fd = eventfd_f(initval, flags | EFD_NONBLOCK);
+	if(fd >= 0)
+	{
+		john::FdMgr::GetInstance()->add(fd, false, flags & EFD_NONBLOCK);
+	}
+	return fd;
+}
+
 // 对 fd 进行控制的操作函数 fcntl 函数的 hook 封装
 int fcntl(int fd, int cmd, ... /* arg */ )
 {
@@ -522,8 +1097,8 @@ int fcntl(int fd, int cmd, ... /* arg */ )
                 // 获取文件描述符对应的上下文
                 std::shared_ptr<john::FdCtx> ctx = john::FdMgr::GetInstance()->get(fd);
                 
-                // 如果上下文无效、文件已关闭或者不是套接字，直接调用默认的 fcntl
-                if(!ctx || ctx->isClosed() || !ctx->isSocket()) 
+                // 如果上下文无效、文件已关闭或者不由 hook 管理非阻塞状态，直接调用默认的 fcntl
+                if(!ctx || ctx->isClosed() || !ctx->isPollable()) 
                 {
                     return fcntl_f(fd, cmd, arg);
                 }
@@ -555,8 +1130,8 @@ int fcntl(int fd, int cmd, ... /* arg */ )
                 // 获取文件描述符对应的上下文
                 std::shared_ptr<john::FdCtx> ctx = john::FdMgr::GetInstance()->get(fd);
                 
-                // 如果上下文无效、文件已关闭或者不是套接字，直接返回当前标志
-                if(!ctx || ctx->isClosed() || !ctx->isSocket()) 
+                // 如果上下文无效、文件已关闭或者不由 hook 管理非阻塞状态，直接返回当前标志
+                if(!ctx || ctx->isClosed() || !ctx->isPollable()) 
                 {
                     return arg;
                 }
@@ -648,8 +1223,8 @@ int ioctl(int fd, unsigned long request, ...)
         bool user_nonblock = !!*(int*)arg; // 获取用户是否设置非阻塞标志
         std::shared_ptr<john::FdCtx> ctx = john::FdMgr::GetInstance()->get(fd);
         
-        // 如果上下文无效、文件已关闭或者不是套接字，直接调用默认的 ioctl
-        if(!ctx || ctx->isClosed() || !ctx->isSocket()) 
+        // 如果上下文无效、文件已关闭或者不由 hook 管理非阻塞状态，直接调用默认的 ioctl
+        if(!ctx || ctx->isClosed() || !ctx->isPollable()) 
         {
             return ioctl_f(fd, request, arg);
         }
@@ -698,5 +1273,277 @@ int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t
     return setsockopt_f(sockfd, level, optname, optval, optlen);	
 }
 
+int poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    if(!john::t_hook_enable) 
+    {
+        return poll_f(fds, nfds, timeout);
+    }
+    return do_poll(fds, nfds, timeout);
+}
+
+int ppoll(struct pollfd *fds, nfds_t nfds, const struct timespec *tmo_p, const sigset_t *sigmask)
+{
+    // 信号掩码需要和等待原子地生效，协程版本做不到，交给原始函数处理
+    if(!john::t_hook_enable || sigmask) 
+    {
+        return ppoll_f(fds, nfds, tmo_p, sigmask);
+    }
+    int timeout_ms = tmo_p ? tmo_p->tv_sec * 1000 + (tmo_p->tv_nsec + 999999) / 1000000 : -1;
+    return do_poll(fds, nfds, timeout_ms);
+}
+
+// select 转换成 pollfd 数组后复用 do_poll，再把 revents 写回 fd_set
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout)
+{
+    if(!john::t_hook_enable) 
+    {
+        return select_f(nfds, readfds, writefds, exceptfds, timeout);
+    }
 
-}
\ No newline at end of file
+    std::vector<struct pollfd> pfds;
+    for(int fd = 0; fd < nfds; ++fd) 
+    {
+        short events = 0;
+        if(readfds && FD_ISSET(fd, readfds)) 
+        {
+            events |= POLLIN;
+        }
+        if(writefds && FD_ISSET(fd, writefds)) 
+        {
+            events |= POLLOUT;
+        }
+        if(exceptfds && FD_ISSET(fd, exceptfds)) 
+        {
+            events |= POLLPRI;
+        }
+        if(events) 
+        {
+            pfds.push_back({fd, events, 0});
+        }
+    }
+
+    int timeout_ms = timeout ? timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000 : -1;
+    int rt = do_poll(pfds.data(), pfds.size(), timeout_ms);
+    if(rt < 0) 
+    {
+        return rt;
+    }
+
+    if(readfds) FD_ZERO(readfds);
+    if(writefds) FD_ZERO(writefds);
+    if(exceptfds) FD_ZERO(exceptfds);
+
+    // select 的返回值是三个集合中置位的总数
+    int count = 0;
+    for(auto& p : pfds) 
+    {
+        if(p.revents & POLLNVAL) 
+        {
+            errno = EBADF;
+            return -1;
+        }
+        if(readfds && (p.events & POLLIN) && (p.revents & (POLLIN | POLLHUP | POLLERR))) 
+        {
+            FD_SET(p.fd, readfds);
+            ++count;
+        }
+        if(writefds && (p.events & POLLOUT) && (p.revents & (POLLOUT | POLLERR))) 
+        {
+            FD_SET(p.fd, writefds);
+            ++count;
+        }
+        if(exceptfds && (p.events & POLLPRI) && (p.revents & POLLPRI)) 
+        {
+            FD_SET(p.fd, exceptfds);
+            ++count;
+        }
+    }
+    return count;
+}
+
+// 用户自己的 epoll 实例：等待 epfd 本身可读，再非阻塞地取出事件
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+    if(!john::t_hook_enable) 
+    {
+        return epoll_wait_f(epfd, events, maxevents, timeout);
+    }
+
+    int n = epoll_wait_f(epfd, events, maxevents, 0);
+    if(n != 0 || timeout == 0) 
+    {
+        return n;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    while(true) 
+    {
+        int remain_ms = -1;
+        if(timeout > 0) 
+        {
+            auto remain = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            remain_ms = remain.count() > 0 ? remain.count() : 0;
+        }
+
+        struct pollfd pfd = {epfd, POLLIN, 0};
+        int rt = do_poll(&pfd, 1, remain_ms);
+        if(rt < 0) 
+        {
+            return rt;
+        }
+
+        n = epoll_wait_f(epfd, events, maxevents, 0);
+        if(n != 0 || rt == 0) 
+        {
+            return n;
+        }
+    }
+}
+
+#endif // JOHN_NO_HOOK
+
+}
+
+namespace john {
+
+// 取出错误队列中的一条消息，记录其中的零拷贝完成区间
+// 队列为空时返回-1且errno为EAGAIN
+static int drain_zerocopy(int fd, const std::shared_ptr<FdCtx>& ctx)
+{
+    char control[128];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if(recvmsg_f(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) 
+    {
+        return -1;
+    }
+
+    for(struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) 
+    {
+        bool is_recverr = (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                       || (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+        if(!is_recverr) 
+        {
+            continue;
+        }
+        struct sock_extended_err* serr = (struct sock_extended_err*)CMSG_DATA(cm);
+        // ee_info到ee_data是本次通知覆盖的发送序号区间
+        if(serr->ee_errno == 0 && serr->ee_origin == SO_EE_ORIGIN_ZEROCOPY) 
+        {
+            ctx->zerocopyDone(serr->ee_data);
+        }
+    }
+    return 0;
+}
+
+// 等待错误队列通知时休眠时间的上下限
+static const uint32_t ZEROCOPY_MIN_WAIT_US = 20;
+static const uint32_t ZEROCOPY_MAX_WAIT_US = 1000;
+
+// 等待错误队列中出现新的通知，被取消时返回false，errno为取消原因
+// 错误队列没有单独的事件可以等待，注册读事件又会占住fd上的读等待者，使同一socket上的recv失败，
+// 这里改为休眠后重新检查，休眠时间从wait_us开始按倍数增长到上限
+static bool wait_zerocopy(int fd, uint32_t& wait_us)
+{
+    IOManager* iom = IOManager::getThis();
+    if(!t_hook_enable || !iom) 
+    {
+        // 错误队列非空时poll总会报告POLLERR，不需要关注任何事件
+        struct pollfd pfd = {fd, 0, 0};
+        poll_f(&pfd, 1, -1);
+        return true;
+    }
+
+    if(!iom->sleepFor(std::chrono::microseconds(wait_us))) 
+    {
+        return false;
+    }
+    wait_us = std::min(wait_us * 2, ZEROCOPY_MAX_WAIT_US);
+    return true;
+}
+
+ssize_t send_zerocopy(int sockfd, const void* buf, size_t len, int flags)
+{
+    std::shared_ptr<FdCtx> ctx = FdMgr::GetInstance()->get(sockfd);
+    if(!ctx || !ctx->isSocket() || ctx->isClosed()) 
+    {
+        return ::send(sockfd, buf, len, flags);
+    }
+
+    // 第一次使用时开启SO_ZEROCOPY，不支持的socket（如unix域socket）以后都直接走普通send
+    if(ctx->getZerocopy() == 0) 
+    {
+        int on = 1;
+        int rt = setsockopt_f(sockfd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on));
+        ctx->setZerocopy(rt == 0 ? 1 : -1);
+    }
+    if(ctx->getZerocopy() < 0) 
+    {
+        return ::send(sockfd, buf, len, flags);
+    }
+
+    // 发送本身经过hook，EAGAIN时同样挂起协程
+    ssize_t n = ::send(sockfd, buf, len, flags | MSG_ZEROCOPY);
+    if(n <= 0) 
+    {
+        return n;
+    }
+
+    // 内核为每次成功的零拷贝发送分配递增的序号，完成通知按序号区间返回
+    uint32_t id = ctx->nextZerocopyId();
+    uint32_t wait_us = ZEROCOPY_MIN_WAIT_US;
+    while(!ctx->isZerocopyDone(id)) 
+    {
+        if(drain_zerocopy(sockfd, ctx) == 0) 
+        {
+            wait_us = ZEROCOPY_MIN_WAIT_US;
+            continue;
+        }
+        if(errno == EINTR) 
+        {
+            continue;
+        }
+        if(errno != EAGAIN || !wait_zerocopy(sockfd, wait_us)) 
+        {
+            return -1;
+        }
+    }
+    return n;
+}
+
+int send_batch(int sockfd, struct mmsghdr* msgs, unsigned int vlen, int flags)
+{
+    unsigned int sent = 0;
+    while(sent < vlen) 
+    {
+        // 经过hook的sendmmsg在发送缓冲区满时挂起协程，这里只需处理部分发送
+        int n = ::sendmmsg(sockfd, msgs + sent, vlen - sent, flags);
+        if(n < 0) 
+        {
+            if(errno == EINTR) 
+            {
+                continue;
+            }
+            return sent > 0 ? (int)sent : -1;
+        }
+        sent += n;
+    }
+    return sent;
+}
+
+int set_udp_segment(int sockfd, int gso_size)
+{
+    return setsockopt_f(sockfd, SOL_UDP, UDP_SEGMENT, &gso_size, sizeof(gso_size));
+}
+
+int set_udp_gro(int sockfd, bool enable)
+{
+    int on = enable ? 1 : 0;
+    return setsockopt_f(sockfd, SOL_UDP, UDP_GRO, &on, sizeof(on));
+}
+
+}
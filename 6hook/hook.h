@@ -7,15 +7,41 @@
 #include <sys/uio.h>
 #include <sys/ioctl.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
 
 //外挂式hook
 //通过优先加载自定义的动态库来实现hook
 //将hook的系统调用同名实现编译为.so动态库，设置LD_PRELOAD环境变量使其优先被加载
+//
+//hook只在启用的线程上生效，调度器可以在构造时为所有工作线程开启（见Scheduler的enable_hook参数）。
+//未启用的线程每次调用只多一次线程局部变量的判断；如果整个程序都不需要hook，
+//编译时加上-DJOHN_NO_HOOK，不再生成任何同名函数，所有调用直接进入libc，没有额外开销
 namespace john {
 
 bool is_hook_enable(); //判断hook是否启动
 void set_hook_enable(bool flag); //设置hook是否启动
 
+//MSG_ZEROCOPY发送：内核直接引用用户缓冲区，不再拷贝数据
+//发送后挂起协程，直到从错误队列收到该次发送的完成通知，返回时buf可以安全复用；
+//等待期间被取消时返回-1，errno为取消原因，此时buf可能仍被内核引用
+//socket不支持SO_ZEROCOPY时退化为普通send。同一个socket同一时刻只应有一个协程使用该接口
+ssize_t send_zerocopy(int sockfd, const void* buf, size_t len, int flags = 0);
+
+//批量发送数据报：循环调用sendmmsg直到vlen个数据报全部发出，发送缓冲区满时挂起协程
+//返回成功发送的数据报数量，一个都没发出就出错时返回-1
+int send_batch(int sockfd, struct mmsghdr* msgs, unsigned int vlen, int flags = 0);
+
+//UDP分段卸载(GSO)：一次发送的大缓冲区由内核按gso_size切分成多个数据报，传0关闭
+int set_udp_segment(int sockfd, int gso_size);
+//UDP接收合并(GRO)：同一条流连续到达的数据报合并后一次交给用户，
+//每段长度通过recvmsg控制信息中的UDP_GRO给出
+int set_udp_gro(int sockfd, bool enable);
+
 }
 
 extern "C" {
@@ -47,12 +73,21 @@ extern "C" {
 	typedef int (*accept_fun) (int sockfd, struct sockaddr *addr, socklen_t *addrlen);
 	extern accept_fun accept_f;
 
+	typedef int (*accept4_fun) (int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags);
+	extern accept4_fun accept4_f;
+
+	typedef int (*socketpair_fun) (int domain, int type, int protocol, int sv[2]);
+	extern socketpair_fun socketpair_f;
+
 	typedef ssize_t (*read_fun) (int fd, void *buf, size_t count);
 	extern read_fun read_f;
 
 	typedef ssize_t (*readv_fun)(int fd, const struct iovec *iov, int iovcnt);
 	extern readv_fun readv_f;
 
+	typedef ssize_t (*pread_fun) (int fd, void *buf, size_t count, off_t offset);
+	extern pread_fun pread_f;
+
 	typedef ssize_t (*recv_fun) (int sockfd, void *buf, size_t len, int flags);
 	extern recv_fun recv_f;
 
@@ -62,12 +97,22 @@ extern "C" {
 	typedef ssize_t (*recvmsg_fun) (int sockfd, struct msghdr *msg, int flags);
 	extern recvmsg_fun recvmsg_f;
 
+	//批量收发：一次唤醒后收取当前已到达的全部数据报（最多vlen个）
+	typedef int (*recvmmsg_fun) (int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags, struct timespec *timeout);
+	extern recvmmsg_fun recvmmsg_f;
+
 	typedef ssize_t (*write_fun) (int fd, const void *buf, size_t count);
 	extern write_fun write_f;
 
 	typedef ssize_t (*writev_fun) (int fd, const struct iovec *iov, int iovcnt);
 	extern writev_fun writev_f;
 
+	typedef ssize_t (*pwrite_fun) (int fd, const void *buf, size_t count, off_t offset);
+	extern pwrite_fun pwrite_f;
+
+	typedef int (*fsync_fun) (int fd);
+	extern fsync_fun fsync_f;
+
 	typedef ssize_t (*send_fun) (int sockfd, const void *buf, size_t len, int flags);
 	extern send_fun send_f;
 
@@ -77,6 +122,39 @@ extern "C" {
 	typedef ssize_t (*sendmsg_fun) (int sockfd, const struct msghdr *msg, int flags);
 	extern sendmsg_fun sendmsg_f;
 
+	typedef int (*sendmmsg_fun) (int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags);
+	extern sendmmsg_fun sendmmsg_f;
+
+    //sendfile/splice/tee零拷贝接口：未就绪时挂起协程，等待相关fd就绪后重试
+    typedef ssize_t (*sendfile_fun) (int out_fd, int in_fd, off_t *offset, size_t count);
+    extern sendfile_fun sendfile_f;
+
+    typedef ssize_t (*splice_fun) (int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len, unsigned int flags);
+    extern splice_fun splice_f;
+
+    typedef ssize_t (*tee_fun) (int fd_in, int fd_out, size_t len, unsigned int flags);
+    extern tee_fun tee_f;
+
+    //dup/pipe/eventfd等创建或复制fd的接口
+    //新fd要登记到FdManager中，hook创建的管道和eventfd同样设为非阻塞并交给epoll等待
+    typedef int (*dup_fun) (int oldfd);
+    extern dup_fun dup_f;
+
+    typedef int (*dup2_fun) (int oldfd, int newfd);
+    extern dup2_fun dup2_f;
+
+    typedef int (*dup3_fun) (int oldfd, int newfd, int flags);
+    extern dup3_fun dup3_f;
+
+    typedef int (*pipe_fun) (int pipefd[2]);
+    extern pipe_fun pipe_f;
+
+    typedef int (*pipe2_fun) (int pipefd[2], int flags);
+    extern pipe2_fun pipe2_f;
+
+    typedef int (*eventfd_fun) (unsigned int initval, int flags);
+    extern eventfd_fun eventfd_f;
+
     //socket/fcntl/ioctl/close等接口
     //处理边缘情况，如：分配fd上下文、处理超时、用户显示设置非阻塞等问题
     typedef int (*close_fun) (int fd);
@@ -94,6 +172,21 @@ extern "C" {
     typedef int (*setsockopt_fun) (int sockfd, int level, int optname, const void *optval, socklen_t optlen);
     extern setsockopt_fun setsockopt_f;
 
+    //poll/select/ppoll/epoll_wait等多路复用接口
+    //hook封装：先非阻塞地检查一次，未就绪则把关注的fd注册到IOManager并挂起协程，
+    //任一fd就绪或超时后恢复协程，再非阻塞地检查一次得到结果。
+    typedef int (*poll_fun) (struct pollfd *fds, nfds_t nfds, int timeout);
+    extern poll_fun poll_f;
+
+    typedef int (*ppoll_fun) (struct pollfd *fds, nfds_t nfds, const struct timespec *tmo_p, const sigset_t *sigmask);
+    extern ppoll_fun ppoll_f;
+
+    typedef int (*select_fun) (int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
+    extern select_fun select_f;
+
+    typedef int (*epoll_wait_fun) (int epfd, struct epoll_event *events, int maxevents, int timeout);
+    extern epoll_wait_fun epoll_wait_f;
+
     // function prototype -> 对应.h中已经存在 可以省略
 	// sleep function 
 	unsigned int sleep(unsigned int seconds);
@@ -104,25 +197,45 @@ extern "C" {
 	int socket(int domain, int type, int protocol);
 	int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen);
 	int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
+	int accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags);
+	int socketpair(int domain, int type, int protocol, int sv[2]);
 
 	// read 
 	ssize_t read(int fd, void *buf, size_t count);
 	ssize_t readv(int fd, const struct iovec *iov, int iovcnt);
 
+    ssize_t pread(int fd, void *buf, size_t count, off_t offset);
+
     ssize_t recv(int sockfd, void *buf, size_t len, int flags);
     ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen);
     ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags);
+    int recvmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags, struct timespec *timeout);
 
     // write
     ssize_t write(int fd, const void *buf, size_t count);
     ssize_t writev(int fd, const struct iovec *iov, int iovcnt);
 
+    ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset);
+    int fsync(int fd);
+
     ssize_t send(int sockfd, const void *buf, size_t len, int flags);
     ssize_t sendto(int sockfd, const void *buf, size_t len, int flags, const struct sockaddr *dest_addr, socklen_t addrlen);
     ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags);
+    int sendmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags);
+
+    // zero copy
+    ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
+    ssize_t splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len, unsigned int flags);
+    ssize_t tee(int fd_in, int fd_out, size_t len, unsigned int flags);
 
     // fd
     int close(int fd);
+    int dup(int oldfd);
+    int dup2(int oldfd, int newfd);
+    int dup3(int oldfd, int newfd, int flags);
+    int pipe(int pipefd[2]);
+    int pipe2(int pipefd[2], int flags);
+    int eventfd(unsigned int initval, int flags);
 
     // socket control
     int fcntl(int fd, int cmd, ... /* arg */ );
@@ -130,6 +243,12 @@ extern "C" {
 
     int getsockopt(int sockfd, int level, int optname, void *optval, socklen_t *optlen);
     int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t optlen);
+
+    // multiplexing
+    int poll(struct pollfd *fds, nfds_t nfds, int timeout);
+    int ppoll(struct pollfd *fds, nfds_t nfds, const struct timespec *tmo_p, const sigset_t *sigmask);
+    int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
+    int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,325 @@
+#include "http.h"
+#include "hook.h"
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <charconv>
+#include <strings.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+namespace john {
+
+static bool iequals(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+//去掉首尾的空格和制表符
+static std::string_view trim(std::string_view s) {
+    while(!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+        s.remove_prefix(1);
+    }
+    while(!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+//判断逗号分隔的列表中是否有指定的token，如Connection: keep-alive, Upgrade
+static bool has_token(std::string_view list, std::string_view token) {
+    while(!list.empty()) {
+        size_t comma = list.find(',');
+        if(iequals(trim(list.substr(0, comma)), token)) {
+            return true;
+        }
+        if(comma == std::string_view::npos) {
+            break;
+        }
+        list.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+//预先格式化好的状态行，发送时直接拷贝
+static std::string_view status_line(int status) {
+    switch(status) {
+        case 200: return "HTTP/1.1 200 OK\r\n";
+        case 201: return "HTTP/1.1 201 Created\r\n";
+        case 204: return "HTTP/1.1 204 No Content\r\n";
+        case 301: return "HTTP/1.1 301 Moved Permanently\r\n";
+        case 302: return "HTTP/1.1 302 Found\r\n";
+        case 304: return "HTTP/1.1 304 Not Modified\r\n";
+        case 400: return "HTTP/1.1 400 Bad Request\r\n";
+        case 403: return "HTTP/1.1 403 Forbidden\r\n";
+        case 404: return "HTTP/1.1 404 Not Found\r\n";
+        case 405: return "HTTP/1.1 405 Method Not Allowed\r\n";
+        case 413: return "HTTP/1.1 413 Payload Too Large\r\n";
+        case 431: return "HTTP/1.1 431 Request Header Fields Too Large\r\n";
+        case 501: return "HTTP/1.1 501 Not Implemented\r\n";
+        case 503: return "HTTP/1.1 503 Service Unavailable\r\n";
+        default:  return "HTTP/1.1 500 Internal Server Error\r\n";
+    }
+}
+
+std::string_view HttpRequest::getHeader(std::string_view name) const {
+    for(auto& h : headers) {
+        if(iequals(h.first, name)) {
+            return h.second;
+        }
+    }
+    return std::string_view();
+}
+
+int HttpParser::parse(std::string_view header, HttpRequest& req) {
+    req.headers.clear();
+    req.body = std::string_view();
+
+    //逐行切分，string_view::find按字符查找时使用memchr，由glibc向量化实现
+    auto next_line = [&header](std::string_view& line) {
+        size_t lf = header.find('\n');
+        if(lf == std::string_view::npos) {
+            return false;
+        }
+        line = header.substr(0, lf);
+        if(!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        header.remove_prefix(lf + 1);
+        return true;
+    };
+
+    //请求行：METHOD SP target SP HTTP/1.x
+    std::string_view line;
+    if(!next_line(line)) {
+        return -1;
+    }
+    size_t sp1 = line.find(' ');
+    size_t sp2 = line.find(' ', sp1 + 1);
+    if(sp1 == 0 || sp1 == std::string_view::npos || sp2 == std::string_view::npos || sp2 == sp1 + 1) {
+        return -1;
+    }
+    req.method = line.substr(0, sp1);
+    req.target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    req.version = line.substr(sp2 + 1);
+    if(req.version != "HTTP/1.1" && req.version != "HTTP/1.0") {
+        return -1;
+    }
+
+    //请求头：name: value，遇到空行结束
+    while(next_line(line) && !line.empty()) {
+        size_t colon = line.find(':');
+        if(colon == 0 || colon == std::string_view::npos) {
+            return -1;
+        }
+        std::string_view name = line.substr(0, colon);
+        if(name.find(' ') != std::string_view::npos || name.find('\t') != std::string_view::npos) {
+            return -1;
+        }
+        req.headers.emplace_back(name, trim(line.substr(colon + 1)));
+    }
+
+    //HTTP/1.1默认保持连接，HTTP/1.0默认关闭，Connection头可以覆盖默认值
+    std::string_view conn = req.getHeader("Connection");
+    if(req.version == "HTTP/1.1") {
+        req.keep_alive = !has_token(conn, "close");
+    } else {
+        req.keep_alive = has_token(conn, "keep-alive");
+    }
+    return 0;
+}
+
+HttpServer::HttpServer(Handler handler)
+    : m_handler(std::move(handler)) {
+}
+
+HttpServer::~HttpServer() {
+    stop();
+}
+
+int HttpServer::bind(uint16_t port, const std::string& ip) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if(inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0) {
+        return -1;
+    }
+
+    int yes = 1;
+    // 解决 "address already in use" 错误
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    if(::bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 1024) < 0) {
+        int err = errno;
+        ::close(fd);
+        errno = err;
+        return -1;
+    }
+
+    m_listenFd = fd;
+    return 0;
+}
+
+void HttpServer::start(IOManager* iom) {
+    m_iom = iom;
+    m_stopping = false;
+    m_iom->schedulerLock(std::bind(&HttpServer::acceptLoop, this));
+}
+
+void HttpServer::stop() {
+    if(m_stopping.exchange(true) || m_listenFd < 0) {
+        return;
+    }
+    //对监听socket调用shutdown会唤醒挂起在accept上的协程，由它自己关闭fd
+    shutdown(m_listenFd, SHUT_RDWR);
+}
+
+void HttpServer::acceptLoop() {
+    while(!m_stopping) {
+        int fd = ::accept(m_listenFd, nullptr, nullptr);
+        if(fd < 0) {
+            if(errno == EMFILE || errno == ENFILE) {
+                //fd耗尽时稍等再试，避免空转
+                usleep(1000);
+            } else if(errno == EINVAL || errno == EBADF) {
+                //监听socket已被shutdown或关闭
+                break;
+            }
+            continue;
+        }
+
+        //响应都是合并后一次发出的，关闭Nagle算法避免小包等待
+        int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        m_iom->schedulerLock(std::bind(&HttpServer::handleClient, this, fd));
+    }
+
+    ::close(m_listenFd);
+    m_listenFd = -1;
+}
+
+//跳过请求之间多余的空行（RFC 7230 3.5允许客户端在请求体之后多发一个CRLF），只处理已经到达的数据
+static void skip_empty_lines(BufferedStream& stream) {
+    while(stream.readable() > 0) {
+        std::string_view buf;
+        stream.peek(buf);
+        size_t n = 0;
+        while(n < buf.size() && (buf[n] == '\r' || buf[n] == '\n')) {
+            ++n;
+        }
+        if(n == 0) {
+            return;
+        }
+        stream.consume(n);
+    }
+}
+
+//缓冲区中是否已经有一个完整的请求头，有的话读取它不会阻塞
+static bool has_request_header(BufferedStream& stream) {
+    if(stream.readable() == 0) {
+        return false;
+    }
+    std::string_view buf;
+    stream.peek(buf);
+    return buf.find("\r\n\r\n") != std::string_view::npos;
+}
+
+void HttpServer::handleClient(int fd) {
+    BufferedStream stream(fd, 4096, m_maxRequestSize);
+    HttpRequest req;
+    HttpResponse rsp;
+    std::string head;
+
+    while(true) {
+        //1.等待完整的请求头到达，不完整时协程挂起等待更多数据
+        //请求在处理完之前不从缓冲区消费，解析结果引用的内存始终有效
+        skip_empty_lines(stream);
+        //pipelining：下一个请求头已经在缓冲区里时先不发送，处理完这一批再合并成一次writev；
+        //否则接下来的读可能挂起，要先把已经生成的响应发出去
+        if(stream.pendingWrite() > 0 && !has_request_header(stream) && stream.flush() < 0) {
+            break;
+        }
+        std::string_view header;
+        ssize_t hlen = stream.peekUntil("\r\n\r\n", header);
+        int status = 0;
+        size_t body_len = 0;
+        if(hlen <= 0) {
+            //请求头超过m_maxRequestSize时回复431后关闭连接
+            if(hlen == 0 || errno != ENOBUFS) {
+                break;
+            }
+            status = 431;
+            hlen = 0;
+        } else if(HttpParser::parse(header, req) < 0) {
+            status = 400;
+        } else if(!req.getHeader("Transfer-Encoding").empty()) {
+            status = 501;
+        } else {
+            //2.按Content-Length等待请求体
+            std::string_view len = req.getHeader("Content-Length");
+            if(!len.empty()) {
+                auto rt = std::from_chars(len.data(), len.data() + len.size(), body_len);
+                if(rt.ec != std::errc() || rt.ptr != len.data() + len.size()) {
+                    status = 400;
+                } else if(body_len > m_maxRequestSize - std::min<size_t>(hlen, m_maxRequestSize)) { //hlen + body_len可能溢出
+                    status = 413;
+                } else if(body_len > 0) {
+                    //请求体还没到齐时读取会挂起，先发出之前的响应
+                    if(stream.readable() < hlen + body_len && stream.flush() < 0) {
+                        break;
+                    }
+                    if(stream.ensure(hlen + body_len) <= 0) {
+                        break;
+                    }
+                    //补齐请求体时缓冲区可能被整理过，重新取出整个请求再解析一次
+                    std::string_view all;
+                    stream.peek(all);
+                    HttpParser::parse(all.substr(0, hlen), req);
+                    req.body = all.substr(hlen, body_len);
+                }
+            }
+        }
+
+        //3.处理请求，出错的请求直接返回错误码并关闭连接
+        rsp = HttpResponse();
+        if(status) {
+            rsp.status = status;
+            rsp.close = true;
+        } else {
+            m_handler(req, rsp);
+        }
+        if(status != 431) {
+            stream.consume(hlen + body_len);
+        }
+        bool keep_alive = !status && req.keep_alive && !rsp.close && !m_stopping;
+
+        //4.拼接响应头，和响应体一起写入写缓冲区
+        char num[24];
+        auto end = std::to_chars(num, num + sizeof(num), rsp.body.size()).ptr;
+        head.clear();
+        head.append(status_line(rsp.status));
+        head.append("Content-Type: ").append(rsp.content_type).append("\r\n");
+        head.append("Content-Length: ").append(num, end - num).append("\r\n");
+        head.append(keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+        if(stream.write(head) < 0 || stream.write(rsp.body) < 0) {
+            break;
+        }
+
+        //5.短连接立即发送并关闭；长连接的响应留到下一轮读之前再决定是否发送
+        if(!keep_alive) {
+            stream.flush();
+            break;
+        }
+    }
+
+    ::close(fd);
+}
+
+}
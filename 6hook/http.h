@@ -0,0 +1,80 @@
+#ifndef _HTTP_H_
+#define _HTTP_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <atomic>
+#include "ioscheduler.h"
+#include "stream.h"
+
+namespace john {
+
+//HTTP请求，所有字段都是指向连接读缓冲区的string_view，只在处理函数执行期间有效
+struct HttpRequest {
+    std::string_view method;
+    std::string_view target;
+    std::string_view version;
+    std::vector<std::pair<std::string_view, std::string_view>> headers;
+    std::string_view body;
+    bool keep_alive = true;
+
+    //按名字查找请求头（不区分大小写），不存在时返回空
+    std::string_view getHeader(std::string_view name) const;
+};
+
+//HTTP响应，由处理函数填写，状态行和固定的响应头由服务器统一生成
+struct HttpResponse {
+    int status = 200;
+    std::string content_type = "text/plain";
+    std::string body;
+    //处理函数可以要求在响应后关闭连接
+    bool close = false;
+};
+
+//解析HTTP/1.1请求头
+//输入是以空行结尾的完整请求头（含"\r\n\r\n"），解析结果直接引用输入的内存，不做拷贝
+class HttpParser {
+public:
+    //成功返回0，格式错误返回-1
+    static int parse(std::string_view header, HttpRequest& req);
+};
+
+//基于IOManager的HTTP/1.1服务器
+//每个连接一个协程，支持keep-alive和pipelining：读缓冲区里已经到达的请求会被连续处理，
+//它们的响应先合并在写缓冲区中，没有待处理的请求时再一次writev发出。
+//连接上的读写依赖hook，IOManager需要以enable_hook=true构造。
+//accept协程和连接协程都引用HttpServer，它必须在IOManager停止之后再析构，即先于IOManager定义
+class HttpServer {
+public:
+    typedef std::function<void(const HttpRequest&, HttpResponse&)> Handler;
+
+    HttpServer(Handler handler);
+    ~HttpServer();
+
+    //监听指定地址，成功返回0，失败返回-1并设置errno
+    int bind(uint16_t port, const std::string& ip = "0.0.0.0");
+    //在IOManager中启动accept协程
+    void start(IOManager* iom);
+    //关闭监听socket，已建立的连接处理完当前请求后结束
+    void stop();
+
+    //单个请求头和请求体的长度上限
+    void setMaxRequestSize(size_t v) {m_maxRequestSize = v;}
+
+private:
+    void acceptLoop();
+    void handleClient(int fd);
+
+private:
+    IOManager* m_iom = nullptr;
+    Handler m_handler;
+    int m_listenFd = -1;
+    size_t m_maxRequestSize = 64 * 1024;
+    std::atomic<bool> m_stopping{false};
+};
+
+}
+
+#endif
@@ -2,8 +2,13 @@
 #include <sys/epoll.h> 
 #include <fcntl.h>     
 #include <cstring>
+#include <chrono>
+#include <cerrno>
 
 #include "ioscheduler.h"
+#include "blocking_pool.h"
+#include "hook.h"
+#include "fiber_sync.h"
 
 static bool debug = false;
 
@@ -24,13 +29,60 @@ IOManager::FdContext::EventContext& IOManager::FdContext::getEventContext(Event
     throw std::invalid_argument("unsuported event type");
 }
 
+//释放节点的线程将其缓存下来供后续addEvent复用
+thread_local IOManager::FdContext::WaitNodeCache IOManager::FdContext::t_waitNodes;
+static const size_t MAX_CACHED_WAIT_NODES = 1024;
+
+IOManager::FdContext::WaitNodeCache::~WaitNodeCache() {
+    while (head) 
+    {
+        WaitNode* next = head->next;
+        delete head;
+        head = next;
+    }
+}
+
+IOManager::FdContext::WaitNode* IOManager::FdContext::allocWaitNode() {
+    WaitNode* node = t_waitNodes.head;
+    if (node) 
+    {
+        t_waitNodes.head = node->next;
+        --t_waitNodes.size;
+        node->next = nullptr;
+        return node;
+    }
+    return new WaitNode();
+}
+
+void IOManager::FdContext::freeWaitNode(WaitNode* node) {
+    if (t_waitNodes.size >= MAX_CACHED_WAIT_NODES) 
+    {
+        delete node;
+        return;
+    }
+    node->next = t_waitNodes.head;
+    t_waitNodes.head = node;
+    ++t_waitNodes.size;
+}
+
+IOManager::FdContext::~FdContext() {
+    resetEventContext(read);
+    resetEventContext(write);
+}
+
 void IOManager::FdContext::resetEventContext(EventContext& ctx) {
     ctx.scheduler = nullptr;
-    ctx.fiber.reset();
-    ctx.cb = nullptr;
+    if (ctx.waiter) 
+    {
+        ctx.waiter->fiber.reset();
+        ctx.waiter->cb = nullptr;
+        ctx.waiter->owner = nullptr;
+        freeWaitNode(ctx.waiter);
+        ctx.waiter = nullptr;
+    }
 }
 
-void IOManager::FdContext::triggerEvent(IOManager::Event event) {
+void IOManager::FdContext::triggerEvent(IOManager::Event event, bool run_local) {
     assert(events & event); //确保event中有指定的事件，否则中断
 
     // delete event
@@ -40,16 +92,18 @@ void IOManager::FdContext::triggerEvent(IOManager::Event event) {
     
     // trigger
     EventContext& ctx = getEventContext(event);
+    WaitNode* waiter = ctx.waiter;
     //相当于取出任务放入任务队列，调度协程完成工作后切换回主协程，再调用run方法执行任务
-    if (ctx.cb) 
+    if (waiter->cb) 
     {
         // call ScheduleTask(std::function<void()>* f, int thr)
-        ctx.scheduler->schedulerLock(&ctx.cb);
+        ctx.scheduler->schedulerLock(&waiter->cb);
     } 
-    else 
+    //在epoll所在线程直接恢复协程，批次满了再放入全局任务队列
+    else if (!run_local || ctx.scheduler != Scheduler::getThis() || !IOManager::scheduleLocal(&waiter->fiber)) 
     {
         // call ScheduleTask(std::shared_ptr<Fiber>* f, int thr)
-        ctx.scheduler->schedulerLock(&ctx.fiber);
+        ctx.scheduler->schedulerLock(&waiter->fiber);
     }
 
     // reset event context
@@ -57,8 +111,8 @@ void IOManager::FdContext::triggerEvent(IOManager::Event event) {
     return;
 }
 
-IOManager::IOManager(size_t threads, bool use_caller, const std::string& name):
-Scheduler(threads, use_caller, name), TimerManager() {
+IOManager::IOManager(size_t threads, bool use_caller, const std::string& name, bool enable_hook):
+Scheduler(threads, use_caller, name, enable_hook), TimerManager() {
     // create epoll fd
     m_epfd = epoll_create(5000);
     assert(m_epfd > 0);
@@ -93,39 +147,43 @@ IOManager::~IOManager() {
     close(m_tickleFds[0]); //关闭管道读端和写段
     close(m_tickleFds[1]);
 
-    //将文件描述符m_FdContext一个个全部关闭
-    for (size_t i = 0; i < m_fdContexts.size(); ++i) 
+    //将文件描述符上下文所在的slab一块块全部释放
+    for (size_t i = 0; i < m_fdSlabs.size(); ++i) 
     {
-        if (m_fdContexts[i]) 
-        {
-            delete m_fdContexts[i];
-        }
+        delete[] m_fdSlabs[i];
     }
 }
 
 void IOManager::contextResize(size_t size) {
-    m_fdContexts.resize(size);
-
-    //初始化未初始化的FdContext对象
-    for (size_t i = 0; i < m_fdContexts.size(); ++i) 
+    //按块追加slab，已分配的FdContext不会移动，epoll中保存的指针始终有效
+    while (m_fdSlabs.size() * FD_SLAB_SIZE < size) 
     {
-        if (m_fdContexts[i]==nullptr) 
+        FdContext* slab = new FdContext[FD_SLAB_SIZE];
+        size_t base = m_fdSlabs.size() * FD_SLAB_SIZE;
+        for (size_t i = 0; i < FD_SLAB_SIZE; ++i) 
         {
-            m_fdContexts[i] = new FdContext();
-            m_fdContexts[i]->fd = i;
+            slab[i].fd = base + i;
         }
+        m_fdSlabs.push_back(slab);
+    }
+}
+
+IOManager::FdContext* IOManager::getFdContext(int fd) const {
+    if (fd < 0 || (size_t)fd >= m_fdSlabs.size() * FD_SLAB_SIZE) 
+    {
+        return nullptr;
     }
+    return &m_fdSlabs[fd / FD_SLAB_SIZE][fd % FD_SLAB_SIZE];
 }
 
-int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
+int IOManager::addEvent(int fd, Event event, std::function<void()> cb, const void* owner) {
     // attemp to find FdContext 
     FdContext *fd_ctx = nullptr;
     
     std::shared_lock<std::shared_mutex> read_lock(m_mutex);
     //fd在数组里则初始化FdContext对象
-    if ((int)m_fdContexts.size() > fd) 
+    if ((fd_ctx = getFdContext(fd))) 
     {
-        fd_ctx = m_fdContexts[fd];
         read_lock.unlock();
     }
     //不存在则重新分配数组大小并初始化
@@ -133,12 +191,12 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
     {
         read_lock.unlock();
         std::unique_lock<std::shared_mutex> write_lock(m_mutex);
-        contextResize(fd * 1.5);
-        fd_ctx = m_fdContexts[fd];
+        contextResize(fd * 1.5 + 1);
+        fd_ctx = getFdContext(fd);
     }
 
     //找到或者创建FdContext对象后，加互斥锁保证其状态不会被其他线程修改
-    std::lock_guard<std::mutex> lock(fd_ctx->mutex);
+    std::lock_guard<SpinLock> lock(fd_ctx->mutex);
     
     //事件如果已经存在，则返回-1，因为不能添加相同的事件
     if(fd_ctx->events & event) 
@@ -169,32 +227,33 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
     // update event context
     FdContext::EventContext& event_ctx = fd_ctx->getEventContext(event);
     //确保事件上下文中没有其他正在执行的调度器、协程或者回调函数
-    assert(!event_ctx.scheduler && !event_ctx.fiber && !event_ctx.cb);
+    assert(!event_ctx.scheduler && !event_ctx.waiter);
     //设置调度器为当前调度器实例
     event_ctx.scheduler = Scheduler::getThis();
+    event_ctx.waiter = FdContext::allocWaitNode();
+    event_ctx.waiter->owner = owner;
 
     if (cb) 
     {
         //保存回调函数的上下文
-        event_ctx.cb.swap(cb);
+        event_ctx.waiter->cb.swap(cb);
     } 
     else 
     {
         //保存协程的上下文，并确保协程状态为runing
-        event_ctx.fiber = Fiber::getThis();
-        assert(event_ctx.fiber->getState() == Fiber::RUNING);
+        event_ctx.waiter->fiber = Fiber::getThis();
+        assert(event_ctx.waiter->fiber->getState() == Fiber::RUNING);
     }
     return 0;
 }
 
-bool IOManager::delEvent(int fd, Event event) {
+bool IOManager::delEvent(int fd, Event event, const void* owner) {
     // attemp to find FdContext 
     FdContext *fd_ctx = nullptr;
     
     std::shared_lock<std::shared_mutex> read_lock(m_mutex);
-    if ((int)m_fdContexts.size() > fd) 
+    if ((fd_ctx = getFdContext(fd))) 
     {
-        fd_ctx = m_fdContexts[fd];
         read_lock.unlock();
     }
     else 
@@ -203,13 +262,18 @@ bool IOManager::delEvent(int fd, Event event) {
         return false;
     }
 
-    std::lock_guard<std::mutex> lock(fd_ctx->mutex);
+    std::lock_guard<SpinLock> lock(fd_ctx->mutex);
 
     // if event doesn't exist,return;else continue
     if (!(fd_ctx->events & event)) 
     {
         return false; //fd_ctx中没有注册该事件
     }
+    //自己的注册已经触发，现在的注册属于其他等待者
+    if (owner && fd_ctx->getEventContext(event).waiter->owner != owner) 
+    {
+        return false;
+    }
 
     // delete the event
     Event new_events = (Event)(fd_ctx->events & ~event); //移除事件标识(句柄)
@@ -241,9 +305,8 @@ bool IOManager::cancelEvent(int fd, Event event) {
     FdContext *fd_ctx = nullptr;
     
     std::shared_lock<std::shared_mutex> read_lock(m_mutex);
-    if ((int)m_fdContexts.size() > fd) 
+    if ((fd_ctx = getFdContext(fd))) 
     {
-        fd_ctx = m_fdContexts[fd];
         read_lock.unlock();
     }
     else 
@@ -252,7 +315,7 @@ bool IOManager::cancelEvent(int fd, Event event) {
         return false;
     }
 
-    std::lock_guard<std::mutex> lock(fd_ctx->mutex);
+    std::lock_guard<SpinLock> lock(fd_ctx->mutex);
 
     // the event doesn't exist
     if (!(fd_ctx->events & event)) 
@@ -288,9 +351,8 @@ bool IOManager::cancelAll(int fd) {
     FdContext *fd_ctx = nullptr;
     
     std::shared_lock<std::shared_mutex> read_lock(m_mutex);
-    if ((int)m_fdContexts.size() > fd) 
+    if ((fd_ctx = getFdContext(fd))) 
     {
-        fd_ctx = m_fdContexts[fd];
         read_lock.unlock();
     }
     else 
@@ -299,7 +361,7 @@ bool IOManager::cancelAll(int fd) {
         return false;
     }
 
-    std::lock_guard<std::mutex> lock(fd_ctx->mutex);
+    std::lock_guard<SpinLock> lock(fd_ctx->mutex);
     
     // none of events exist
     if (!fd_ctx->events) 
@@ -345,8 +407,30 @@ void IOManager::tickle() {
     }
     //如果有空闲协程，在管道m_tickleFds[1]中写入字符"T",
     //向管道另一端m_tickleFds[0]发送该消息，通知有新任务可以处理了。
-    int rt = write(m_tickleFds[1], "T", 1);
-    assert(rt == 1);
+    //直接调用原始write，管道已满时同样能唤醒idle协程，EAGAIN可以忽略
+    int rt = write_f(m_tickleFds[1], "T", 1);
+    assert(rt == 1 || errno == EAGAIN);
+    //管道只能唤醒epoll_wait上的leader，follower挂在条件变量上，也唤醒一个去取任务
+    if(isLeaderFollower()) 
+    {
+        wakeFollowers(false);
+    }
+}
+
+void IOManager::wakeFollowers(bool all) {
+    //持锁递增代数，正要开始等待的follower会看到代数变化，不会错过这次唤醒
+    {
+        std::lock_guard<std::mutex> lock(m_leaderMutex);
+        ++m_leaderGen;
+    }
+    if (all) 
+    {
+        m_leaderCond.notify_all();
+    }
+    else 
+    {
+        m_leaderCond.notify_one();
+    }
 }
 
 bool IOManager::stopping() {
@@ -357,9 +441,106 @@ bool IOManager::stopping() {
     return timeout == ~0ull && m_pendingEventCount == 0 && Scheduler::stopping();
 }
 
+bool IOManager::sleepUntil(std::chrono::steady_clock::time_point deadline) {
+    CancelToken* cancel = CancelToken::current();
+    if(!cancel) {
+        std::shared_ptr<Fiber> fiber = Fiber::getThis();
+        addSleeper(deadline, fiber);
+        //挂起当前协程，到期后由idle协程重新调度
+        fiber->yield();
+        return true;
+    }
+
+    //睡眠者的最小堆不支持删除，可取消的睡眠改用定时器：到期(0)和取消(1)只有先claim的一方唤醒协程
+    auto token = std::make_shared<WakeToken>();
+    token->waiter = FiberWaiter::current();
+    CancelRegistration reg;
+    if(!reg.reset(cancel, [token]() {
+        if(token->claim(1)) {
+            token->waiter.wake();
+        }
+    })) {
+        set_errno(CancelToken::currentError());
+        return false;
+    }
+
+    //令牌的截止时间不晚于deadline时，到期由截止时间的定时器取消令牌唤醒，不再设置自己的定时器
+    std::shared_ptr<Timer> timer;
+    if(cancel->deadline() > deadline) {
+        auto now = std::chrono::steady_clock::now();
+        uint64_t ms = deadline > now ? std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count() : 0;
+        timer = addTimer(ms, [token]() {
+            if(token->claim(0)) {
+                token->waiter.wake();
+            }
+        });
+    }
+    Fiber::getThis()->yield();
+
+    reg.release();
+    if(token->winner == 1) {
+        if(timer) {
+            timer->cancel();
+        }
+        set_errno(CancelToken::currentError());
+        return false;
+    }
+    return true;
+}
+
+bool IOManager::sleepFor(std::chrono::microseconds us) {
+    return sleepUntil(std::chrono::steady_clock::now() + us);
+}
+
+//以微秒精度等待epoll事件，内核不支持epoll_pwait2时退回到毫秒精度的epoll_wait（超时向上取整）
+static int epollWaitUs(int epfd, epoll_event* events, int maxevents, uint64_t timeout_us) {
+    static std::atomic<bool> s_has_pwait2{true};
+    if (s_has_pwait2.load(std::memory_order_relaxed)) 
+    {
+        timespec ts;
+        ts.tv_sec = timeout_us / 1000000;
+        ts.tv_nsec = (timeout_us % 1000000) * 1000;
+        int rt = epoll_pwait2(epfd, events, maxevents, &ts, nullptr);
+        if (!(rt < 0 && errno == ENOSYS)) 
+        {
+            return rt;
+        }
+        s_has_pwait2.store(false, std::memory_order_relaxed);
+    }
+    return epoll_wait_f(epfd, events, maxevents, (int)((timeout_us + 999) / 1000));
+}
+
+void IOManager::submitBlocking(std::function<void()> cb) {
+    ++m_pendingEventCount;
+    BlockingPoolMgr::GetInstance()->submit([this, cb]() 
+    {
+        cb();
+        --m_pendingEventCount;
+    });
+}
+
+void IOManager::setPollPolicy(PollPolicy policy, uint64_t spin_us) {
+    m_spinUs.store(spin_us, std::memory_order_relaxed);
+    m_pollPolicy.store(policy, std::memory_order_relaxed);
+    //唤醒正在阻塞的idle协程，让新策略尽快生效
+    tickle();
+}
+
+void IOManager::setLeaderFollower(bool enable) {
+    m_leaderFollower.store(enable, std::memory_order_relaxed);
+    if (!enable) 
+    {
+        //关闭时唤醒所有follower，让它们回到各自的epoll_wait
+        wakeFollowers(true);
+    }
+}
+
 void IOManager::idle() {
-    static const uint64_t MAX_EVNETS = 256;
-    std::unique_ptr<epoll_event[]> events(new epoll_event[MAX_EVNETS]);
+    //epoll_wait单次返回的事件数上限，一次取满说明负载较重，按倍数扩大直到MAX_EVENTS
+    static const uint64_t INIT_EVENTS = 256;
+    static const uint64_t MAX_EVENTS = 4096;
+    uint64_t batch = INIT_EVENTS;
+    std::unique_ptr<epoll_event[]> events(new epoll_event[batch]);
 
     while (true) 
     {
@@ -368,29 +549,81 @@ void IOManager::idle() {
         if(stopping()) 
         {
             if(debug) std::cout << "name = " << getName() << " idle exits in thread: " << Thread::getThreadID() << std::endl;
+            //唤醒所有follower，让它们也检查到调度器正在停止
+            wakeFollowers(true);
+            //idle会一次读空tickle管道，stop()发出的多次tickle可能只唤醒了一个线程，
+            //退出前再tickle一次，把唤醒传给下一个仍在epoll_wait中的线程
+            tickle();
             break;
         }
 
+        //run()插入的轮询：还有任务在排队，只以0超时检查一次epoll，也不参与leader/follower
+        bool poll_only = isPollOnly();
+        bool is_leader = false;
+        if (isLeaderFollower() && !poll_only) 
+        {
+            std::unique_lock<std::mutex> lock(m_leaderMutex);
+            if (m_hasLeader) 
+            {
+                //已有leader在等待事件，作为follower挂起线程，直到leader让位、有新任务、关闭该模式或调度器停止，
+                //这几处都经过wakeFollowers或在持锁时递增代数，不需要超时兜底
+                uint64_t gen = m_leaderGen;
+                m_leaderCond.wait(lock, [this, gen]() {
+                    return m_leaderGen != gen || !isLeaderFollower();
+                });
+                lock.unlock();
+                //被唤醒后先回到run()检查任务队列，下一轮再竞争leader
+                Fiber::getThis()->yield();
+                continue;
+            }
+            m_hasLeader = true;
+            is_leader = true;
+        }
+
+        PollPolicy policy = getPollPolicy();
+        //SPIN_THEN_BLOCK下自旋的截止时间
+        auto spin_deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(m_spinUs.load(std::memory_order_relaxed));
+
         // blocked at epoll_wait
         int rt = 0;
         while(true)
         {
-            static const uint64_t MAX_TIMEOUT = 5000;
-            uint64_t next_timeout = getNextTimer();
+            static const uint64_t MAX_TIMEOUT = 5000 * 1000;
+            uint64_t next_timeout = getNextTimerUs();
             next_timeout = std::min(next_timeout, MAX_TIMEOUT); //避免等待时间过长
 
-            rt = epoll_wait(m_epfd, events.get(), MAX_EVNETS, (int)next_timeout);
+            //自旋阶段以0超时轮询，有定时器到期时立即返回去处理
+            bool spinning = !poll_only && next_timeout != 0 && (policy == BUSY_POLL || 
+                (policy == SPIN_THEN_BLOCK && std::chrono::steady_clock::now() < spin_deadline));
+
+            //调用原始的epoll_wait，即使工作线程开启了hook也不会进入hook版本
+            rt = epollWaitUs(m_epfd, events.get(), batch, spinning || poll_only ? 0 : next_timeout);
             // EINTR -> retry
             if(rt < 0 && errno == EINTR) //rt<0表示无限阻塞，EINTR表示信号中断
             {
                 continue;
             } 
+            else if(rt == 0 && spinning)
+            {
+                continue;
+            }
             else 
             {
                 break;
             }
         }; //end epoll_wait
 
+        //leader拿到事件后立即让位并唤醒一个follower接替等待，自己再去处理这批事件
+        if (is_leader) 
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_leaderMutex);
+                m_hasLeader = false;
+                ++m_leaderGen;
+            }
+            m_leaderCond.notify_one();
+        }
+
         // collect all timers overdue
         std::vector<std::function<void()>> cbs; //储存超时定时器回调的容器
         listExpiredTimerCb(cbs); //获取所有超时定时器的回调
@@ -402,6 +635,17 @@ void IOManager::idle() {
             }
             cbs.clear();
         }
+
+        // wake up sleeping fibers, preferably on this thread
+        std::vector<std::shared_ptr<Fiber>> sleepers;
+        listExpiredSleepers(sleepers);
+        for(auto& fiber : sleepers) 
+        {
+            if(!scheduleLocal(&fiber)) 
+            {
+                schedulerLock(&fiber);
+            }
+        }
         
         // collect all events ready
         for (int i = 0; i < rt; ++i) 
@@ -413,13 +657,13 @@ void IOManager::idle() {
             {
                 uint8_t dummy[256];
                 // edge triggered -> exhaust
-                while (read(m_tickleFds[0], dummy, sizeof(dummy)) > 0);
+                while (read_f(m_tickleFds[0], dummy, sizeof(dummy)) > 0);
                 continue;
             }
 
             // other events
             FdContext *fd_ctx = (FdContext *)event.data.ptr;
-            std::lock_guard<std::mutex> lock(fd_ctx->mutex);
+            std::lock_guard<SpinLock> lock(fd_ctx->mutex);
 
             // convert EPOLLERR or EPOLLHUP to -> read or write event
             if (event.events & (EPOLLERR | EPOLLHUP)) 
@@ -458,15 +702,23 @@ void IOManager::idle() {
             //触发事件，事件执行。这里的triggerEvent会将事件放入调度器开始调度并执行
             if (real_events & READ) 
             {
-                fd_ctx->triggerEvent(READ);
+                fd_ctx->triggerEvent(READ, true);
                 --m_pendingEventCount;
             }
             if (real_events & WRITE) 
             {
-                fd_ctx->triggerEvent(WRITE);
+                fd_ctx->triggerEvent(WRITE, true);
                 --m_pendingEventCount;
             }
         } // end for
+
+        //本轮取满了整个数组，下一轮扩大批量，减少高负载下epoll_wait的调用次数
+        if ((uint64_t)rt == batch && batch < MAX_EVENTS) 
+        {
+            batch *= 2;
+            events.reset(new epoll_event[batch]);
+        }
+
         //当前线程主动让出控制权，调度器可以选择执行其他任务或再次进入idle状态
         Fiber::getThis()->yield();
   
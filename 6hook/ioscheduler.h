@@ -16,16 +16,32 @@ public:
         WRITE = 0x4 //表示写事件
     };
 
+    //idle协程等待IO事件的方式
+    enum PollPolicy {
+        BLOCK = 0, //直接阻塞在epoll_wait上，直到有事件或定时器超时
+        SPIN_THEN_BLOCK = 1, //先以0超时轮询epoll一段时间，仍无事件再阻塞
+        BUSY_POLL = 2 //始终以0超时轮询，不让出CPU，换取最低的唤醒延迟
+    };
+
 private:
     //用于描述一个文件描述符的事件上下文
     //每个socket fd都对应一个FdContext，包括fd值(句柄整数值)，fd上的事件，以及fd的读写事件上下文
+    //空闲连接只占用两个指针大小的事件上下文，挂起的协程或回调保存在可复用的WaitNode中
     struct FdContext {
+        //挂起在事件上的任务节点：协程或回调函数二选一
+        //节点由线程本地的空闲链表复用，避免每次等待都分配内存
+        struct WaitNode {
+            std::shared_ptr<Fiber> fiber;
+            std::function<void()> cb;
+            const void* owner = nullptr; //注册者给出的标识，delEvent据此只删除自己的注册
+            WaitNode* next = nullptr;
+        };
+
         //描述一个事件的上下文
         struct EventContext {
-            //事件关联的调度器、协程或回调函数
+            //事件关联的调度器和等待者，没有事件时均为空
             Scheduler* scheduler = nullptr; 
-            std::shared_ptr<Fiber> fiber;
-            std::function<void()> cb;
+            WaitNode* waiter = nullptr;
         };
 
         EventContext read; //读的上下文
@@ -34,24 +50,40 @@ private:
         int fd = 0; // 事件关联的句柄
         Event events = NONE; //当前注册的事件
 
-        std::mutex mutex;
+        SpinLock mutex; //临界区只有几次赋值和一次epoll_ctl，自旋锁比std::mutex小得多
+
+        ~FdContext();
+
+        //线程本地的WaitNode空闲链表，线程退出时统一释放缓存的节点
+        struct WaitNodeCache {
+            WaitNode* head = nullptr;
+            size_t size = 0;
+            ~WaitNodeCache();
+        };
+        static thread_local WaitNodeCache t_waitNodes;
+
+        //从线程本地缓存中取出/归还WaitNode
+        static WaitNode* allocWaitNode();
+        static void freeWaitNode(WaitNode* node);
 
         //根据事件类型获取事件上下文
         EventContext& getEventContext(Event event);
         //重置事件上下文
         void resetEventContext(EventContext& ctx);
         //根据事件类型调用对应的调度器去调度协程或者函数
-        void triggerEvent(Event event);    
+        //run_local为true时，属于当前调度器的协程优先放入本线程的本地批次
+        void triggerEvent(Event event, bool run_local = false);    
     };
 
 public:
-    IOManager(size_t threads = -1, bool use_caller = true, const std::string& name = "IOManager");
+    IOManager(size_t threads = -1, bool use_caller = true, const std::string& name = "IOManager", bool enable_hook = false);
     ~IOManager();
 
     // add one event at a time to a fd, and link to a cb
-    int addEvent(int fd, Event event, std::function<void()> cb = nullptr);
-    // delete event on a fd
-    bool delEvent(int fd, Event event);
+    // owner tags the registration so that delEvent can tell it apart from a later one on the same fd/event
+    int addEvent(int fd, Event event, std::function<void()> cb = nullptr, const void* owner = nullptr);
+    // delete event on a fd; with owner set, only a registration added with the same owner is deleted
+    bool delEvent(int fd, Event event, const void* owner = nullptr);
     // delete the event on a fd and trigger its callback
     bool cancelEvent(int fd, Event event);
     // delete all events and trigger its callback
@@ -59,6 +91,24 @@ public:
     // get current scheduler object
     static IOManager* getThis();
 
+    //挂起当前协程直到绝对时间点deadline，精度为微秒，不分配定时器和回调
+    //当前协程有CancelToken时改用毫秒精度的定时器，被取消时提前返回false，errno为取消原因
+    bool sleepUntil(std::chrono::steady_clock::time_point deadline);
+    //挂起当前协程一段时间
+    bool sleepFor(std::chrono::microseconds us);
+
+    //把阻塞操作交给阻塞IO线程池执行，完成前计入待处理事件，保证调度器不会提前停止
+    void submitBlocking(std::function<void()> cb);
+
+    //设置idle协程的轮询策略，spin_us为SPIN_THEN_BLOCK下阻塞前的自旋时长(微秒)
+    void setPollPolicy(PollPolicy policy, uint64_t spin_us = 50);
+    PollPolicy getPollPolicy() const {return (PollPolicy)m_pollPolicy.load(std::memory_order_relaxed);}
+
+    //领导者/跟随者模式：同一时刻只有一个空闲线程(leader)阻塞在epoll_wait上，
+    //其余空闲线程(follower)在条件变量上等待，leader拿到事件后先唤醒一个follower接替，再处理自己的事件
+    void setLeaderFollower(bool enable);
+    bool isLeaderFollower() const {return m_leaderFollower.load(std::memory_order_relaxed);}
+
 protected:
     //通知调度器有任务需要进行调度
     void tickle() override;
@@ -69,8 +119,12 @@ protected:
     void idle() override;
 
     void timerInsertedAtFront() override;
+    //唤醒在条件变量上等待的follower，all为false时只唤醒一个
+    void wakeFollowers(bool all);
     //调整文件描述符上下文数组的大小
     void contextResize(size_t size);
+    //根据fd找到对应的FdContext，调用者需持有m_mutex读锁或写锁
+    FdContext* getFdContext(int fd) const;
 
 private:
     int m_epfd = 0; //epoll文件描述符
@@ -79,8 +133,17 @@ private:
     //atomic该变量的操作是原子性的，不会被多线程影响
     std::atomic<size_t> m_pendingEventCount = {0}; //原子计数器，记录待处理的事件
     std::shared_mutex m_mutex; //读写锁
+    std::atomic<int> m_pollPolicy = {BLOCK}; //idle协程的轮询策略
+    std::atomic<uint64_t> m_spinUs = {50}; //SPIN_THEN_BLOCK策略下的自旋预算(微秒)
+    std::atomic<bool> m_leaderFollower = {false}; //是否启用领导者/跟随者模式
+    std::mutex m_leaderMutex; //保护m_hasLeader和m_leaderGen
+    std::condition_variable m_leaderCond; //follower在此等待leader让位
+    bool m_hasLeader = false; //当前是否已有线程在epoll_wait上
+    uint64_t m_leaderGen = 0; //每次唤醒follower时递增，follower据此判断等待期间是否有过唤醒
+    //每块slab连续存放FD_SLAB_SIZE个FdContext，fd为i的上下文位于m_fdSlabs[i / FD_SLAB_SIZE]
+    static const size_t FD_SLAB_SIZE = 1024;
     // store fdcontexts for each fd
-    std::vector<FdContext *> m_fdContexts; //文件描述符上下文数组，储存每个文件描述符的FdContext
+    std::vector<FdContext *> m_fdSlabs; //文件描述符上下文slab数组，扩容只追加新slab，已有FdContext地址不变
 };
 
 }
@@ -0,0 +1,65 @@
+#include "parallel.h"
+#include "future.h"
+
+namespace john {
+
+//调用者和调度器上的任务共享的状态
+//最后完成的块负责通知调用者。调用者返回后body已经失效，晚到的任务只会看到计数器越界，不会再访问body
+struct ChunkContext {
+    const std::function<void(size_t)>* body;
+    size_t nchunks;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    FutureState<void> join;
+
+    void work() {
+        size_t c;
+        while((c = next.fetch_add(1, std::memory_order_relaxed)) < nchunks) {
+            if(!failed.load(std::memory_order_relaxed)) {
+                try {
+                    (*body)(c);
+                } catch(...) {
+                    if(!failed.exchange(true)) {
+                        error = std::current_exception();
+                    }
+                }
+            }
+            if(done.fetch_add(1, std::memory_order_acq_rel) + 1 == nchunks) {
+                join.setValue();
+            }
+        }
+    }
+};
+
+void parallel_chunks(Scheduler* sc, size_t nchunks, const std::function<void(size_t)>& body) {
+    if(nchunks == 0) {
+        return;
+    }
+    if(nchunks == 1) {
+        body(0);
+        return;
+    }
+
+    auto ctx = std::make_shared<ChunkContext>();
+    ctx->body = &body;
+    ctx->nchunks = nchunks;
+
+    //调用者自己也领取块，最多再派发nchunks-1个任务
+    size_t tasks = std::min(sc->getThreadCount(), nchunks - 1);
+    for(size_t i = 0; i < tasks; ++i) {
+        sc->schedulerLock(std::function<void()>([ctx]() {
+            ctx->work();
+        }));
+    }
+    ctx->work();
+
+    //任务还在使用body，等待不能被取消
+    ctx->join.wait(false);
+    if(ctx->error) {
+        std::rethrow_exception(ctx->error);
+    }
+}
+
+}
@@ -0,0 +1,119 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <vector>
+#include "scheduler.h"
+
+namespace john {
+
+//基于调度器任务的fork-join数据并行算法
+//区间按grain切成若干块，调度器上最多getThreadCount()个任务和调用者一起从共享计数器领取块执行，
+//块的大小不均匀时空闲的任务会多领，调用者等待剩余块完成时挂起协程（普通线程则阻塞），不占用工作线程，
+//因此可以在任务中嵌套调用。块中抛出的第一个异常在全部块结束后由调用者重新抛出，其余未开始的块被跳过。
+//grain为0时按工作线程数自动选择，每个线程大约分到8块。
+
+//把[0, nchunks)的每个块交给body执行，返回前所有块都已完成
+void parallel_chunks(Scheduler* sc, size_t nchunks, const std::function<void(size_t)>& body);
+
+namespace detail {
+
+inline size_t default_grain(Scheduler* sc, size_t n) {
+    size_t chunks = std::max<size_t>(sc->getThreadCount(), 1) * 8;
+    return std::max<size_t>(n / chunks, 1);
+}
+
+}
+
+//对[begin, end)的每个块调用f(chunk_begin, chunk_end)
+template<class F>
+void parallel_for_range(Scheduler* sc, size_t begin, size_t end, F f, size_t grain = 0) {
+    if(begin >= end) {
+        return;
+    }
+    size_t n = end - begin;
+    if(grain == 0) {
+        grain = detail::default_grain(sc, n);
+    }
+    size_t nchunks = (n + grain - 1) / grain;
+    parallel_chunks(sc, nchunks, [&](size_t c) {
+        size_t b = begin + c * grain;
+        f(b, std::min(b + grain, end));
+    });
+}
+
+//对[begin, end)的每个下标调用f(i)
+template<class F>
+void parallel_for(Scheduler* sc, size_t begin, size_t end, F f, size_t grain = 0) {
+    parallel_for_range(sc, begin, end, [&](size_t b, size_t e) {
+        for(size_t i = b; i < e; ++i) {
+            f(i);
+        }
+    }, grain);
+}
+
+//每个块计算f(chunk_begin, chunk_end, identity)，再按块的顺序用reduce合并，reduce不要求满足交换律
+template<class T, class F, class R>
+T parallel_reduce(Scheduler* sc, size_t begin, size_t end, T identity, F f, R reduce, size_t grain = 0) {
+    if(begin >= end) {
+        return identity;
+    }
+    size_t n = end - begin;
+    if(grain == 0) {
+        grain = detail::default_grain(sc, n);
+    }
+    size_t nchunks = (n + grain - 1) / grain;
+    std::vector<T> partial(nchunks, identity);
+    parallel_chunks(sc, nchunks, [&](size_t c) {
+        size_t b = begin + c * grain;
+        partial[c] = f(b, std::min(b + grain, end), identity);
+    });
+
+    T result = std::move(partial[0]);
+    for(size_t c = 1; c < nchunks; ++c) {
+        result = reduce(std::move(result), std::move(partial[c]));
+    }
+    return result;
+}
+
+//并行归并排序：先把区间切成若干段分别std::sort，再逐轮两两std::inplace_merge，每轮的归并并行执行
+//元素少于grain（默认16384）时直接std::sort。不保证稳定
+template<class RandomIt, class Compare = std::less<typename std::iterator_traits<RandomIt>::value_type>>
+void parallel_sort(Scheduler* sc, RandomIt first, RandomIt last, Compare comp = Compare(), size_t grain = 0) {
+    size_t n = last - first;
+    if(grain == 0) {
+        grain = 16384;
+    }
+    size_t pieces = std::min(std::max<size_t>(sc->getThreadCount(), 1), n / grain);
+    if(pieces <= 1) {
+        std::sort(first, last, comp);
+        return;
+    }
+
+    std::vector<size_t> bounds(pieces + 1);
+    for(size_t i = 0; i <= pieces; ++i) {
+        bounds[i] = n * i / pieces;
+    }
+    parallel_chunks(sc, pieces, [&](size_t i) {
+        std::sort(first + bounds[i], first + bounds[i + 1], comp);
+    });
+
+    for(size_t width = 1; width < pieces; width *= 2) {
+        size_t merges = (pieces + 2 * width - 1) / (2 * width);
+        parallel_chunks(sc, merges, [&](size_t m) {
+            size_t lo = m * 2 * width;
+            size_t mid = lo + width;
+            if(mid >= pieces) {
+                return;
+            }
+            size_t hi = std::min(mid + width, pieces);
+            std::inplace_merge(first + bounds[lo], first + bounds[mid], first + bounds[hi], comp);
+        });
+    }
+}
+
+}
+
+#endif
@@ -1,4 +1,7 @@
 #include "scheduler.h"
+#include "hook.h"
+#include <algorithm>
+#include <deque>
 
 /*关键思路：多线程结合多协程。
 多线程通过互斥锁取任务，利用线程局部变量让线程各自调用自己的子协程执行任务。
@@ -10,6 +13,12 @@ static bool debug = true;
 namespace john {
 
 static thread_local Scheduler* t_scheduler = nullptr;
+//当前线程的本地就绪协程批次，由idle协程填充，run()优先取出执行
+static thread_local std::deque<std::shared_ptr<Fiber>> t_local_fibers;
+//当前线程的idle协程，只有它可以填充本地批次
+static thread_local Fiber* t_idle_fiber = nullptr;
+//idle协程本次运行是否只轮询不阻塞
+static thread_local bool t_poll_only = false;
 
 //返回t_scheduler调度器线程
 Scheduler* Scheduler::getThis() {
@@ -21,8 +30,32 @@ void Scheduler::setThis() {
     t_scheduler = this;
 }
 
-Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name):
-m_use_caller(use_caller), m_name(name) {
+bool Scheduler::scheduleLocal(std::shared_ptr<Fiber>* fiber) {
+    //只有idle协程在让出后批次才会被run()取走，批次也只会在每次进入idle时补充一轮，不会一直占着run()
+    if(!t_idle_fiber || Fiber::getThisPtr() != t_idle_fiber || t_local_fibers.size() >= MAX_LOCAL_BATCH) {
+        return false;
+    }
+    t_local_fibers.emplace_back();
+    t_local_fibers.back().swap(*fiber);
+    return true;
+}
+
+bool Scheduler::scheduleHandoff(std::shared_ptr<Fiber>* fiber) {
+    //t_idle_fiber只在run()中有效；idle协程自己走scheduleLocal
+    if(!t_idle_fiber || Fiber::getThisPtr() == t_idle_fiber || !t_local_fibers.empty()) {
+        return false;
+    }
+    t_local_fibers.emplace_back();
+    t_local_fibers.back().swap(*fiber);
+    return true;
+}
+
+bool Scheduler::isPollOnly() {
+    return t_poll_only;
+}
+
+Scheduler::Scheduler(size_t threads, bool use_caller, const std::string& name, bool enable_hook):
+m_use_caller(use_caller), m_name(name), m_enable_hook(enable_hook) {
     assert(threads > 0 && Scheduler::getThis() == nullptr);
 
     setThis();
@@ -43,7 +76,7 @@ m_use_caller(use_caller), m_name(name) {
         m_thread_id.push_back(m_main_thread);
     }
 
-    m_main_thread = threads;
+    m_thread_count = threads;
     if(debug) std::cout << "Scheduler::Scheduler() success\n";
 }
 
@@ -82,7 +115,11 @@ void Scheduler::run() {
     int thread_id = Thread::getThreadID(); //获取当前线程
     if(debug) std::cout << "Scheduler::run() starts in thread: " << thread_id << std::endl;
 
-    //set_hook_enable(true);
+    //按构造参数开启hook。caller线程在调度结束后还要继续使用，退出run()时恢复它原来的设置
+    bool old_hook_enable = is_hook_enable();
+    if(m_enable_hook) {
+        set_hook_enable(true);
+    }
 
     setThis(); //设置调度器对象
 
@@ -93,33 +130,67 @@ void Scheduler::run() {
     
     //创建空闲协程
     std::shared_ptr<Fiber> idle_fiber = std::make_shared<Fiber>(std::bind(&Scheduler::idle, this));
+    t_idle_fiber = idle_fiber.get();
     ScheduleTask task;
+    size_t since_idle = 0;   //上次运行idle协程之后执行的任务数
+    size_t local_streak = 0; //连续从本地批次取出的协程数
 
     while(true) {
         task.reset();
         bool tickle_me = false; //是否唤醒其他线程进行任务调度
 
-        {
+        //任务不断时idle协程没有机会运行，epoll事件、到期的定时器和睡眠的协程都得不到处理，
+        //定期让它不阻塞地轮询一次
+        if(since_idle >= IDLE_POLL_INTERVAL && idle_fiber->getState() != Fiber::TERM) {
+            since_idle = 0;
+            t_poll_only = true;
+            idle_fiber->resume();
+            t_poll_only = false;
+        }
+
+        //0.优先执行idle协程留在本线程的就绪协程，无需加锁；
+        //全局队列中有更高优先级的任务，或连续取出MAX_LOCAL_BATCH个之后全局队列中有任务时，先去全局队列取一个
+        if(!t_local_fibers.empty() && !hasQueuedAbove(t_local_fibers.front()->getPriority())
+            && (local_streak < MAX_LOCAL_BATCH || m_task_count == 0)) {
+            task.fiber.swap(t_local_fibers.front());
+            t_local_fibers.pop_front();
+            ++local_streak;
+            m_active_thread_count++;
+        } else {
+            local_streak = 0;
             std::lock_guard<std::mutex> lock(m_mutex);
-            auto it = m_tasks.begin();
-
-            //1.遍历任务队列
-            while(it != m_tasks.end()) {
-                //跳过那些指定给其他线程执行的任务
-                if(it->thread != -1 && it->thread != thread_id) {
-                    it++;
-                    tickle_me = true;
-                    continue;
+            int order[PRIORITY_COUNT];
+            priorityOrder(order);
+
+            //1.按策略给出的顺序遍历各优先级的任务队列
+            for(int i = 0; i < PRIORITY_COUNT && !task.fiber && !task.cb; ++i) {
+                std::vector<ScheduleTask>& tasks = m_tasks[order[i]];
+                for(auto it = tasks.begin(); it != tasks.end(); ++it) {
+                    //跳过那些指定给其他线程执行的任务
+                    if(it->thread != -1 && it->thread != thread_id) {
+                        tickle_me = true;
+                        continue;
+                    }
+
+                    //2.线程取出任务
+                    assert(it->fiber || it->cb);
+                    task = *it;
+                    tasks.erase(it);
+                    --m_task_count;
+                    --m_queued[order[i]];
+                    onDequeue(order[i]);
+                    m_active_thread_count++;
+                    break; //取到任务的线程直接break
                 }
+            }
+            tickle_me = tickle_me || m_task_count > 0;
 
-                //2.线程取出任务
-                assert(it->fiber || it->cb);
-                task = *it;
-                m_tasks.erase(it);
+            //全局队列中的任务都绑定在其他线程上，本地批次还有协程时直接取出
+            if(!task.fiber && !task.cb && !t_local_fibers.empty()) {
+                task.fiber.swap(t_local_fibers.front());
+                t_local_fibers.pop_front();
                 m_active_thread_count++;
-                break; //取到任务的线程直接break
             }
-            tickle_me = tickle_me || (it != m_tasks.end());
         }
 
         if(tickle_me) {
@@ -137,21 +208,29 @@ void Scheduler::run() {
             }
             m_active_thread_count--; //线程完成调度任务后即认为不再活跃，并进入空闲状态
             task.reset();
+            ++since_idle;
         } else if(task.cb) {
             //将函数封装成协程进行执行
             std::shared_ptr<Fiber> cb_fiber = std::make_shared<Fiber>(task.cb);
+            cb_fiber->setPriority(task.priority);
             {
                 std::lock_guard<std::mutex> lock(cb_fiber->m_mutex);
                 cb_fiber->resume();
             }
             m_active_thread_count--;
             task.reset();
+            ++since_idle;
         //没有任务，则执行空闲协程
         } else {
             if(idle_fiber->getState() == Fiber::TERM) {
                 if(debug) std::cout << "Scheduler::run() end in thread: " << thread_id << std::endl;
+                //idle协程退出后本线程可能还执行了本地交接的协程，其他线程仍阻塞在idle中，唤醒它们重新检查是否停止
+                tickle();
+                t_idle_fiber = nullptr;
+                set_hook_enable(old_hook_enable);
                 break;
             }
+            since_idle = 0;
             m_idle_thread_count++;
             idle_fiber->resume();
             m_idle_thread_count--;
@@ -212,14 +291,85 @@ void Scheduler::tickle() {
 void Scheduler::idle() {
     while(!stopping()) {
         if(debug) std::cout << "Scheduler::idle(), sleeping in thread: " << Thread::getThreadID() <<std::endl;
-        sleep(1); //降低空闲线程在无调度任务时对CPU的占用率，避免空转浪费资源
+        //降低空闲线程在无调度任务时对CPU的占用率，避免空转浪费资源；run()插入的轮询直接让出
+        if(!isPollOnly()) {
+            sleep(1);
+        }
         Fiber::getThis()->yield();
     }
 }
 
 bool Scheduler::stopping() {
     std::lock_guard<std::mutex> lock(m_mutex);
-    return m_stopping && m_tasks.empty() && m_active_thread_count == 0;
+    return m_stopping && m_task_count == 0 && m_active_thread_count == 0;
+}
+
+void Scheduler::setPriorityPolicy(PriorityPolicy policy, uint32_t starvation_limit) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_priorityPolicy = policy;
+    m_starvationLimit = starvation_limit;
+}
+
+void Scheduler::setPriorityWeights(uint32_t high, uint32_t normal, uint32_t low) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_weights[PRIORITY_HIGH] = std::max(high, 1u);
+    m_weights[PRIORITY_NORMAL] = std::max(normal, 1u);
+    m_weights[PRIORITY_LOW] = std::max(low, 1u);
+    std::copy(m_weights, m_weights + PRIORITY_COUNT, m_credits);
+}
+
+void Scheduler::priorityOrder(int order[PRIORITY_COUNT]) {
+    int n = 0;
+    bool used[PRIORITY_COUNT] = {};
+    auto add = [&](int p) {
+        if(!used[p]) {
+            used[p] = true;
+            order[n++] = p;
+        }
+    };
+
+    //饿死保护：被越过次数达到上限的队列最先尝试，低优先级的排在前面
+    if(m_starvationLimit) {
+        for(int p = PRIORITY_COUNT - 1; p > 0; --p) {
+            if(m_skipped[p] >= m_starvationLimit && !m_tasks[p].empty()) {
+                add(p);
+            }
+        }
+    }
+
+    if(m_priorityPolicy == WEIGHTED) {
+        //所有非空队列本轮的额度都用完后开始新的一轮
+        bool has_credit = false;
+        for(int p = 0; p < PRIORITY_COUNT; ++p) {
+            if(m_credits[p] && !m_tasks[p].empty()) {
+                has_credit = true;
+            }
+        }
+        if(!has_credit) {
+            std::copy(m_weights, m_weights + PRIORITY_COUNT, m_credits);
+        }
+        for(int p = 0; p < PRIORITY_COUNT; ++p) {
+            if(m_credits[p]) {
+                add(p);
+            }
+        }
+    }
+
+    //STRICT，以及额度用完但仍可能因为线程绑定而需要尝试的队列，按优先级从高到低
+    for(int p = 0; p < PRIORITY_COUNT; ++p) {
+        add(p);
+    }
+}
+
+void Scheduler::onDequeue(int priority) {
+    if(m_credits[priority]) {
+        --m_credits[priority];
+    }
+    m_skipped[priority] = 0;
+    //更低优先级的非空队列又被越过了一次
+    for(int p = priority + 1; p < PRIORITY_COUNT; ++p) {
+        m_skipped[p] = m_tasks[p].empty() ? 0 : m_skipped[p] + 1;
+    }
 }
 
 
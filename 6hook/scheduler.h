@@ -10,11 +10,37 @@
 namespace john {
 
 class Scheduler {
+    friend struct FiberWaiter;
 public:
-    Scheduler(size_t thread = 1, bool use_caller = true, const std::string& name = "Scheduler");
+    //enable_hook为true时，每个工作线程进入run()后自动开启hook，不需要在任务里手动调用set_hook_enable
+    Scheduler(size_t thread = 1, bool use_caller = true, const std::string& name = "Scheduler", bool enable_hook = false);
     virtual ~Scheduler(); //虚析构函数确保基类指针删除子类对象时，正确调用子类析构函数释放资源
 
     const std::string& getName() const {return m_name;}
+    bool isHookEnable() const {return m_enable_hook;}
+    //工作线程数，use_caller时包含主线程
+    size_t getThreadCount() const {return m_thread_count + (m_use_caller ? 1 : 0);}
+
+public:
+    //任务的优先级类别，数值越小越优先。每个类别一个任务队列，类别内先进先出
+    enum Priority {
+        PRIORITY_INHERIT = -1, //协程任务沿用协程自己的优先级，回调任务沿用当前协程的优先级
+        PRIORITY_HIGH = 0,     //延迟敏感的任务，如处理请求
+        PRIORITY_NORMAL = 1,
+        PRIORITY_LOW = 2       //后台任务，如压缩、刷盘
+    };
+    static const int PRIORITY_COUNT = 3;
+
+    //在各优先级队列之间选择任务的策略
+    enum PriorityPolicy {
+        STRICT = 0,  //总是先取优先级最高的非空队列
+        WEIGHTED = 1 //按权重在非空队列之间轮流取任务，每轮从各队列最多取权重个
+    };
+    //starvation_limit为防饿死保护：非空的低优先级队列被更高优先级的任务连续越过这么多次后，
+    //下一次先从它取一个任务；为0时不做保护
+    void setPriorityPolicy(PriorityPolicy policy, uint32_t starvation_limit = 64);
+    //WEIGHTED策略下各优先级的权重，至少为1
+    void setPriorityWeights(uint32_t high, uint32_t normal, uint32_t low);
 
 public:
     static Scheduler* getThis(); //获取正在运行的调度器
@@ -23,17 +49,21 @@ protected:
     void setThis(); //设置正在运行的调度器
 
 public:
-    //添加任务到任务队列
+    //添加任务到priority对应的任务队列。显式给出的priority只决定这一次调度进入哪个队列，
+    //不会改变协程自己的优先级，之后PRIORITY_INHERIT的唤醒仍沿用协程原来的优先级
     template <class FiberOrCb>
-    void schedulerLock(FiberOrCb fc, int thread = -1) {
+    void schedulerLock(FiberOrCb fc, int thread = -1, int priority = PRIORITY_INHERIT) {
         bool need_tickle;
         {
             std::lock_guard<std::mutex> lock(m_mutex);
-            need_tickle = m_tasks.empty();
+            need_tickle = m_task_count == 0;
 
             ScheduleTask task(fc, thread); //通过传入不同的参数调用不同的任务构造函数
             if(task.fiber || task.cb) {
-                m_tasks.push_back(task);
+                task.priority = taskPriority(task, priority);
+                m_tasks[task.priority].push_back(task);
+                ++m_task_count;
+                ++m_queued[task.priority];
             }
         }
 
@@ -58,12 +88,29 @@ protected:
 
     bool hasIdleThreads() {return m_idle_thread_count > 0;}
 
+    //把就绪协程放入当前线程的本地批次，idle协程让出后由run()直接恢复执行，
+    //不经过全局任务队列，省去一次加锁，也不会被其他线程取走。只能在idle协程中调用，否则或批次已满时返回false。
+    //run()取批次中的协程前会检查全局队列，有更高优先级的任务时先执行它们
+    static bool scheduleLocal(std::shared_ptr<Fiber>* fiber);
+    //协程之间的直接交接：本线程run()正在执行的任务协程唤醒另一个协程时，本地批次为空才放入批次，
+    //当前协程让出后run()直接恢复它，省去全局队列的加锁和tickle。批次里只放这一个，其余唤醒仍进全局队列，
+    //可以被空闲线程取走；连续交接受MAX_LOCAL_BATCH和IDLE_POLL_INTERVAL限制，不会饿死全局队列和idle协程
+    static bool scheduleHandoff(std::shared_ptr<Fiber>* fiber);
+
+    //本地批次的容量，超出部分仍然放入全局任务队列；run()连续从批次取出这么多个协程后，全局队列有任务时先取一个
+    static const size_t MAX_LOCAL_BATCH = 64;
+    //任务不断时，run()每执行这么多个任务让idle协程不阻塞地轮询一次
+    static const size_t IDLE_POLL_INTERVAL = 64;
+    //idle协程是否是run()为了轮询而插入的一次运行，此时不能阻塞等待，处理完就绪的事件后立即让出
+    static bool isPollOnly();
+
 private:
     //任务结构体
     struct ScheduleTask {
         std::shared_ptr<Fiber> fiber;
         std::function<void()> cb;
         int thread;
+        int priority = PRIORITY_NORMAL;
 
         //默认构造
         ScheduleTask() {
@@ -96,9 +143,36 @@ private:
             fiber = nullptr;
             cb = nullptr;
             thread = -1;
+            priority = PRIORITY_NORMAL;
         }
     };
 
+    //把PRIORITY_INHERIT和越界的取值换成实际的优先级
+    static int taskPriority(const ScheduleTask& task, int priority) {
+        if(priority >= 0 && priority < PRIORITY_COUNT) {
+            return priority;
+        }
+        if(task.fiber) {
+            return task.fiber->getPriority();
+        }
+        return Fiber::inFiber() ? Fiber::getThisPtr()->getPriority() : PRIORITY_NORMAL;
+    }
+
+    //全局队列中是否有比priority更高优先级的任务，不加锁读取作为提示
+    bool hasQueuedAbove(int priority) const {
+        for(int i = 0; i < priority && i < PRIORITY_COUNT; ++i) {
+            if(m_queued[i] > 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //按策略排出本次取任务时依次尝试的队列顺序，调用时持有m_mutex
+    void priorityOrder(int order[PRIORITY_COUNT]);
+    //从priority队列取出一个任务后更新权重和饿死计数，调用时持有m_mutex
+    void onDequeue(int priority);
+
 private:
     std::string m_name;
 
@@ -106,7 +180,15 @@ private:
 
     std::vector<std::shared_ptr<Thread>> m_threads; //线程池
 
-    std::vector<ScheduleTask> m_tasks; //任务队列
+    std::vector<ScheduleTask> m_tasks[PRIORITY_COUNT]; //各优先级的任务队列
+    std::atomic<size_t> m_task_count = {0}; //所有队列中的任务总数，run()可以不加锁读取作为提示
+    std::atomic<size_t> m_queued[PRIORITY_COUNT] = {}; //各优先级队列中的任务数
+
+    PriorityPolicy m_priorityPolicy = STRICT;
+    uint32_t m_starvationLimit = 64;
+    uint32_t m_weights[PRIORITY_COUNT] = {8, 4, 1};
+    uint32_t m_credits[PRIORITY_COUNT] = {8, 4, 1}; //WEIGHTED策略下本轮各队列剩余可取的任务数
+    uint32_t m_skipped[PRIORITY_COUNT] = {}; //非空队列被更高优先级任务连续越过的次数
 
     std::vector<int> m_thread_id; //线程ID
 
@@ -124,6 +206,8 @@ private:
     int m_main_thread = -1;
 
     bool m_stopping = false;//是否正在关闭
+
+    bool m_enable_hook = false; //工作线程是否自动开启hook
 };
 
 }
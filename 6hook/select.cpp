@@ -0,0 +1,139 @@
+#include "select.h"
+#include <cassert>
+#include <cerrno>
+
+namespace john {
+
+//回调可能在Select返回之后才执行（事件已经触发、回调还在任务队列中），因此持有token的shared_ptr
+static std::function<void()> make_wakeup(const std::shared_ptr<WakeToken>& token, int index) {
+    return [token, index]() {
+        if(token->claim(index)) {
+            token->waiter.wake();
+        }
+    };
+}
+
+struct Select::EventCase : public Select::Case {
+    IOManager* iom = nullptr;
+    int fd;
+    IOManager::Event event;
+    bool armed = false;
+    //回调是否已经运行，也作为注册的owner标识
+    std::shared_ptr<std::atomic<bool>> fired;
+
+    EventCase(int fd_, IOManager::Event event_) : fd(fd_), event(event_) {}
+
+    ArmResult arm(const std::shared_ptr<WakeToken>& token, int index) override {
+        iom = IOManager::getThis();
+        assert(iom);
+        fired = std::make_shared<std::atomic<bool>>(false);
+        std::function<void()> wakeup = make_wakeup(token, index);
+        std::shared_ptr<std::atomic<bool>> flag = fired;
+        if(iom->addEvent(fd, event, [flag, wakeup]() {
+            *flag = true;
+            wakeup();
+        }, fired.get()) == 0) {
+            armed = true;
+            return ARMED;
+        }
+        //注册失败（如该事件已被其他协程注册）时直接作为结果返回
+        if(token->claim(index)) {
+            ok = false;
+            return WON;
+        }
+        return LOST;
+    }
+
+    void disarm(bool won) override {
+        //已经触发的事件（胜出的，或者触发了但没抢到的）在epoll上的注册已被移除，不能再删，
+        //以免误删之后其他协程注册的同一事件；回调还在任务队列中时由owner标识区分
+        if(armed && !won && !*fired) {
+            iom->delEvent(fd, event, fired.get());
+        }
+    }
+};
+
+struct Select::TimerCase : public Select::Case {
+    uint64_t ms;
+    std::shared_ptr<Timer> timer;
+
+    explicit TimerCase(uint64_t ms_) : ms(ms_) {}
+
+    ArmResult arm(const std::shared_ptr<WakeToken>& token, int index) override {
+        IOManager* iom = IOManager::getThis();
+        assert(iom);
+        timer = iom->addTimer(ms, make_wakeup(token, index));
+        return ARMED;
+    }
+
+    void disarm(bool won) override {
+        if(!won) {
+            timer->cancel();
+        }
+    }
+};
+
+int Select::addCase(std::unique_ptr<Case> c) {
+    m_cases.push_back(std::move(c));
+    return m_cases.size() - 1;
+}
+
+int Select::onEvent(int fd, IOManager::Event event) {
+    return addCase(std::unique_ptr<Case>(new EventCase(fd, event)));
+}
+
+int Select::onTimeout(uint64_t ms) {
+    return addCase(std::unique_ptr<Case>(new TimerCase(ms)));
+}
+
+int Select::wait() {
+    if(m_cases.empty()) {
+        return -1;
+    }
+
+    auto token = std::make_shared<WakeToken>();
+    token->waiter = FiberWaiter::current();
+
+    //取消作为一个额外的等待源，序号排在所有等待源之后
+    int cancel_index = m_cases.size();
+    CancelRegistration reg;
+    if(!reg.reset(CancelToken::current(), [token, cancel_index]() {
+        if(token->claim(cancel_index)) {
+            token->waiter.wake();
+        }
+    })) {
+        set_errno(CancelToken::currentError());
+        return -1;
+    }
+
+    //依次登记，某个等待源已经就绪时停止，后面的不再登记
+    size_t armed = 0;
+    bool won = false;
+    for(; armed < m_cases.size(); ++armed) {
+        ArmResult rt = m_cases[armed]->arm(token, armed);
+        if(rt == ARMED) {
+            continue;
+        }
+        won = rt == WON;
+        break;
+    }
+
+    //除了登记时当前协程自己claim成功，其余情况都有等待源已经或将要唤醒当前协程，必须yield一次
+    if(!won) {
+        Fiber::getThis()->yield();
+    }
+
+    int winner = token->winner;
+    assert(winner >= 0);
+    for(size_t i = 0; i < armed; ++i) {
+        m_cases[i]->disarm((int)i == winner);
+    }
+    //胜出的等待源是立即就绪的那一个时，它也在armed之外，不需要撤销
+    if(winner == cancel_index) {
+        set_errno(CancelToken::currentError());
+        return -1;
+    }
+    return winner;
+}
+
+}
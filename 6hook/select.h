@@ -0,0 +1,104 @@
+#ifndef _SELECT_H_
+#define _SELECT_H_
+
+#include <memory>
+#include <vector>
+#include "channel.h"
+#include "ioscheduler.h"
+
+namespace john {
+
+//把一个协程同时挂在多个等待源上：通道接收、fd上的IO事件和定时器
+//所有等待源共享一个WakeToken，第一个claim成功的等待源胜出并唤醒协程，其余等待源随后被撤销：
+//通道接收方从等待队列中摘除，IO事件用delEvent删除，定时器cancel，都不会触发回调。
+//一个Select对象只能wait一次，IO事件和定时器要求在IOManager中运行的协程里使用。
+//
+//  john::Select sel;
+//  int r = sel.onRecv(ch, msg);
+//  int t = sel.onTimeout(100);
+//  int i = sel.wait();
+//  if(i == r && sel.ok(r)) {...} else if(i == t) {...}
+class Select {
+public:
+    Select() = default;
+    Select(const Select&) = delete;
+    Select& operator=(const Select&) = delete;
+
+    //从ch接收一个元素写入out，返回该等待源的序号；胜出后ok为false表示通道已关闭
+    template<class T>
+    int onRecv(Channel<T>& ch, T& out) {
+        std::unique_ptr<RecvCase<T>> c(new RecvCase<T>(ch));
+        c->waiter.value = &out;
+        return addCase(std::move(c));
+    }
+
+    //等待fd上的读或写事件，返回该等待源的序号；胜出后ok为false表示注册事件失败
+    int onEvent(int fd, IOManager::Event event);
+
+    //ms毫秒后超时，返回该等待源的序号
+    int onTimeout(uint64_t ms);
+
+    //挂起当前协程直到某个等待源就绪，返回胜出的序号；没有等待源时返回-1
+    //当前协程的CancelToken被取消时撤销所有等待源，返回-1，errno为取消原因
+    int wait();
+
+    //胜出的等待源是否正常完成
+    bool ok(int index) const {return m_cases[index]->ok;}
+
+private:
+    enum ArmResult {
+        ARMED,  //已登记，等待异步唤醒
+        WON,    //等待源立即就绪且当前协程claim成功，不需要挂起
+        LOST    //其他等待源已经胜出并唤醒了当前协程
+    };
+
+    struct Case {
+        bool ok = true;
+
+        virtual ~Case() {}
+        virtual ArmResult arm(const std::shared_ptr<WakeToken>& token, int index) = 0;
+        virtual void disarm(bool won) = 0;
+    };
+
+    template<class T>
+    struct RecvCase : public Case {
+        Channel<T>& channel;
+        typename Channel<T>::Waiter waiter;
+
+        explicit RecvCase(Channel<T>& ch) : channel(ch) {}
+
+        ArmResult arm(const std::shared_ptr<WakeToken>& token, int index) override {
+            //登记在通道中的是裸指针，Select在wait返回前会撤销登记，token不会先于它销毁
+            waiter.token = token.get();
+            waiter.index = index;
+            if(!channel.armRecv(waiter)) {
+                return ARMED;
+            }
+            if(token->winner == index) {
+                ok = waiter.ok;
+                return WON;
+            }
+            return LOST;
+        }
+
+        void disarm(bool won) override {
+            if(won) {
+                ok = waiter.ok;
+            } else {
+                channel.disarmRecv(waiter);
+            }
+        }
+    };
+
+    struct EventCase;
+    struct TimerCase;
+
+    int addCase(std::unique_ptr<Case> c);
+
+private:
+    std::vector<std::unique_ptr<Case>> m_cases;
+};
+
+}
+
+#endif
@@ -0,0 +1,227 @@
+#include "stream.h"
+#include "hook.h"
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+namespace john {
+
+//在[begin, end)中查找delim，返回第一次出现的位置，找不到返回nullptr
+//先用memchr定位分隔符的首字节，glibc的memchr按SSE2/AVX2向量化实现，一次比较16/32个字节，
+//命中后再用memcmp比较剩余部分
+static const char* find_delim(const char* begin, const char* end, std::string_view delim) {
+    size_t dlen = delim.size();
+    while(begin + dlen <= end) {
+        const char* p = (const char*)memchr(begin, delim[0], end - begin - dlen + 1);
+        if(!p) {
+            return nullptr;
+        }
+        if(memcmp(p + 1, delim.data() + 1, dlen - 1) == 0) {
+            return p;
+        }
+        begin = p + 1;
+    }
+    return nullptr;
+}
+
+BufferedStream::BufferedStream(int fd, size_t buffer_size, size_t max_buffer)
+    : m_fd(fd)
+    , m_maxBuffer(std::max(buffer_size, max_buffer))
+    , m_wlimit(buffer_size) {
+    m_rbuf.resize(buffer_size);
+}
+
+ssize_t BufferedStream::fill() {
+    if(m_begin == m_end) {
+        m_begin = m_end = m_scanned = 0;
+    }
+
+    //缓冲区尾部没有空间：先把未消费的数据移到开头，已经在开头则扩容
+    if(m_end == m_rbuf.size()) {
+        if(m_begin > 0) {
+            memmove(m_rbuf.data(), m_rbuf.data() + m_begin, m_end - m_begin);
+            m_scanned = m_scanned > m_begin ? m_scanned - m_begin : 0;
+            m_end -= m_begin;
+            m_begin = 0;
+        } else if(m_rbuf.size() < m_maxBuffer) {
+            m_rbuf.resize(std::min(m_rbuf.size() * 2, m_maxBuffer));
+        } else {
+            errno = ENOBUFS;
+            return -1;
+        }
+    }
+
+    ssize_t n;
+    do {
+        n = ::read(m_fd, m_rbuf.data() + m_end, m_rbuf.size() - m_end);
+    } while(n < 0 && errno == EINTR);
+
+    if(n > 0) {
+        m_end += n;
+    }
+    return n;
+}
+
+ssize_t BufferedStream::peekUntil(std::string_view delim, std::string_view& out) {
+    if(delim.empty()) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    while(true) {
+        //从上次扫描结束的位置继续查找
+        size_t from = std::max(m_begin, m_scanned);
+        const char* data = m_rbuf.data();
+        const char* p = find_delim(data + from, data + m_end, delim);
+        if(p) {
+            size_t len = p + delim.size() - (data + m_begin);
+            out = std::string_view(data + m_begin, len);
+            return len;
+        }
+
+        //分隔符可能被两次读取截断，保留最后delim.size()-1个字节下次重新扫描
+        size_t keep = delim.size() - 1;
+        m_scanned = m_end - m_begin > keep ? m_end - keep : m_begin;
+
+        ssize_t n = fill();
+        if(n <= 0) {
+            return n;
+        }
+    }
+}
+
+ssize_t BufferedStream::readUntil(std::string_view delim, std::string_view& out) {
+    ssize_t n = peekUntil(delim, out);
+    if(n > 0) {
+        m_begin += n;
+        m_scanned = m_begin;
+    }
+    return n;
+}
+
+ssize_t BufferedStream::ensure(size_t n) {
+    if(n > m_maxBuffer) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    while(readable() < n) {
+        ssize_t rt = fill();
+        if(rt <= 0) {
+            return rt;
+        }
+    }
+    return readable();
+}
+
+ssize_t BufferedStream::readExact(size_t n, std::string_view& out) {
+    ssize_t rt = ensure(n);
+    if(rt <= 0) {
+        return rt;
+    }
+
+    out = std::string_view(m_rbuf.data() + m_begin, n);
+    m_begin += n;
+    return n;
+}
+
+ssize_t BufferedStream::peek(std::string_view& out) {
+    if(readable() == 0) {
+        ssize_t rt = fill();
+        if(rt <= 0) {
+            return rt;
+        }
+    }
+
+    out = std::string_view(m_rbuf.data() + m_begin, readable());
+    return out.size();
+}
+
+void BufferedStream::consume(size_t n) {
+    m_begin += std::min(n, readable());
+    m_scanned = std::max(m_scanned, m_begin);
+}
+
+ssize_t BufferedStream::read(void* buf, size_t len) {
+    if(readable() == 0) {
+        //请求的数据比缓冲区还大时直接读到用户的内存里，省去一次拷贝
+        if(len >= m_rbuf.size()) {
+            ssize_t n;
+            do {
+                n = ::read(m_fd, buf, len);
+            } while(n < 0 && errno == EINTR);
+            return n;
+        }
+
+        ssize_t rt = fill();
+        if(rt <= 0) {
+            return rt;
+        }
+    }
+
+    size_t n = std::min(len, readable());
+    memcpy(buf, m_rbuf.data() + m_begin, n);
+    m_begin += n;
+    return n;
+}
+
+int BufferedStream::writeAll(struct iovec* iov, int iovcnt) {
+    while(iovcnt > 0) {
+        ssize_t n = ::writev(m_fd, iov, iovcnt);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        //跳过已经完整写出的部分，剩余部分继续发送
+        while(iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if(iovcnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+ssize_t BufferedStream::write(const void* buf, size_t len) {
+    if(len >= m_wlimit) {
+        struct iovec iov[2];
+        int cnt = 0;
+        if(!m_wbuf.empty()) {
+            iov[cnt++] = {(void*)m_wbuf.data(), m_wbuf.size()};
+        }
+        iov[cnt++] = {(void*)buf, len};
+        if(writeAll(iov, cnt) < 0) {
+            return -1;
+        }
+        m_wbuf.clear();
+        return len;
+    }
+
+    m_wbuf.append((const char*)buf, len);
+    if(m_wbuf.size() >= m_wlimit && flush() < 0) {
+        return -1;
+    }
+    return len;
+}
+
+int BufferedStream::flush() {
+    if(m_wbuf.empty()) {
+        return 0;
+    }
+
+    struct iovec iov = {(void*)m_wbuf.data(), m_wbuf.size()};
+    if(writeAll(&iov, 1) < 0) {
+        return -1;
+    }
+    m_wbuf.clear();
+    return 0;
+}
+
+}
@@ -0,0 +1,71 @@
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/uio.h>
+
+namespace john {
+
+//带缓冲的流，封装一个经过hook的fd
+//读写都通过hook后的read/writev进行，数据未就绪时挂起当前协程而不是阻塞线程。
+//读出的数据以string_view的形式直接指向内部缓冲区，不做拷贝，
+//它只在下一次读操作（readUntil/readExact/peek/read）之前有效。
+//
+//读接口的返回值与系统调用一致：>0为数据长度，0表示对端关闭，-1表示出错并设置errno
+class BufferedStream {
+public:
+    //max_buffer为读缓冲区的上限，一条消息超过该长度时读操作返回-1，errno为ENOBUFS
+    BufferedStream(int fd, size_t buffer_size = 4096, size_t max_buffer = 64 * 1024);
+
+    int getFd() const {return m_fd;}
+
+    //读到delim为止（包含delim），out指向这段数据
+    ssize_t readUntil(std::string_view delim, std::string_view& out);
+    //读满n个字节
+    ssize_t readExact(size_t n, std::string_view& out);
+    //与readUntil相同，但不消费数据，out在下一次读操作之前有效
+    ssize_t peekUntil(std::string_view delim, std::string_view& out);
+    //保证缓冲区中至少有n个未消费的字节，返回当前可读的长度
+    ssize_t ensure(size_t n);
+    //返回缓冲区中已有的数据但不消费；缓冲区为空时先读一次
+    ssize_t peek(std::string_view& out);
+    //消费peek看到的前n个字节
+    void consume(size_t n);
+    //读取不超过len个字节，优先使用缓冲区中的数据
+    ssize_t read(void* buf, size_t len);
+
+    //写入先进入缓冲区，合并后一次writev发出；缓冲区超过上限时自动flush
+    //大块数据不再拷贝进缓冲区，而是和已缓冲的数据一起通过writev直接发送
+    ssize_t write(const void* buf, size_t len);
+    ssize_t write(std::string_view data) {return write(data.data(), data.size());}
+    //把缓冲的数据全部写出，成功返回0
+    int flush();
+
+    //缓冲区中尚未消费的数据长度
+    size_t readable() const {return m_end - m_begin;}
+    size_t pendingWrite() const {return m_wbuf.size();}
+
+private:
+    //从fd读一次数据追加到缓冲区末尾，必要时先整理或扩容缓冲区
+    ssize_t fill();
+    //把iov中的数据全部写出，处理部分写入
+    int writeAll(struct iovec* iov, int iovcnt);
+
+private:
+    int m_fd;
+    size_t m_maxBuffer;
+
+    std::vector<char> m_rbuf;
+    size_t m_begin = 0; //未消费数据的起点
+    size_t m_end = 0; //已读入数据的终点
+    size_t m_scanned = 0; //readUntil已扫描过、确认不含分隔符的位置，避免重复扫描
+
+    std::string m_wbuf; //待发送的小块数据
+    size_t m_wlimit;
+};
+
+}
+
+#endif
@@ -0,0 +1,95 @@
+#include "task_group.h"
+#include <cassert>
+#include "future.h"
+
+namespace john {
+
+struct TaskGroup::State {
+    CancelToken::ptr token;
+    std::mutex mutex;
+    size_t running = 0;
+    //每轮从0个子协程变为1个时重新创建，最后一个子协程结束时完成
+    std::shared_ptr<FutureState<void>> done;
+    std::exception_ptr error;
+
+    void run(const std::function<void()>& cb) {
+        CancelToken::setCurrent(token);
+        try {
+            cb();
+        } catch(...) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(!error) {
+                    error = std::current_exception();
+                }
+            }
+            token->cancel();
+        }
+        CancelToken::setCurrent(nullptr);
+
+        std::shared_ptr<FutureState<void>> finished;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(--running == 0) {
+                finished = done;
+            }
+        }
+        if(finished) {
+            finished->setValue();
+        }
+    }
+};
+
+TaskGroup::TaskGroup(Scheduler* sc) 
+    : m_scheduler(sc ? sc : Scheduler::getThis())
+    , m_token(CancelToken::create(CancelToken::currentPtr()))
+    , m_state(std::make_shared<State>()) {
+    assert(m_scheduler);
+    m_state->token = m_token;
+}
+
+TaskGroup::~TaskGroup() {
+    wait();
+}
+
+void TaskGroup::spawn(std::function<void()> cb, int thread) {
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        if(m_state->running++ == 0) {
+            m_state->done = std::make_shared<FutureState<void>>();
+        }
+    }
+    std::shared_ptr<State> state = m_state;
+    m_scheduler->schedulerLock(std::function<void()>([state, cb]() {
+        state->run(cb);
+    }), thread);
+}
+
+void TaskGroup::join() {
+    wait();
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        error.swap(m_state->error);
+    }
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void TaskGroup::wait() {
+    //等待期间子协程可能继续spawn，计数归零后再检查一次
+    while(true) {
+        std::shared_ptr<FutureState<void>> done;
+        {
+            std::lock_guard<std::mutex> lock(m_state->mutex);
+            if(m_state->running == 0) {
+                return;
+            }
+            done = m_state->done;
+        }
+        done->wait(false);
+    }
+}
+
+}
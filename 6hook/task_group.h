@@ -0,0 +1,54 @@
+#ifndef _TASK_GROUP_H_
+#define _TASK_GROUP_H_
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include "cancel.h"
+#include "scheduler.h"
+
+namespace john {
+
+//结构化并发：TaskGroup拥有它启动的子协程，join（或析构）时挂起直到所有子协程结束。
+//每个组有自己的CancelToken，创建时挂在当前协程的令牌下面，外层取消会传递到所有子协程；
+//子协程中被hook的IO、sleep、Channel、FiberSemaphore、FiberConditionVariable、Future和Select
+//在取消后尽快返回ECANCELED。任一子协程抛出异常时取消整个组，join重新抛出第一个异常。
+//
+//  john::TaskGroup group;
+//  group.spawn([]() {...});
+//  group.spawn([]() {...});
+//  group.join();
+class TaskGroup {
+public:
+    //sc为空时使用当前线程的调度器
+    explicit TaskGroup(Scheduler* sc = nullptr);
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+    //析构时等待所有子协程结束，没有join取走的异常被丢弃
+    ~TaskGroup();
+
+    //在调度器上启动一个子协程，子协程中也可以继续向同一个组spawn
+    void spawn(std::function<void()> cb, int thread = -1);
+    //挂起直到所有子协程结束，有子协程抛出异常时重新抛出第一个异常。等待本身不会被取消
+    void join();
+
+    void cancel() {m_token->cancel();}
+    bool isCancelled() const {return m_token->isCancelled();}
+    const CancelToken::ptr& token() const {return m_token;}
+
+private:
+    //子协程结束时组对象可能已经析构，共享状态由子协程一起持有
+    struct State;
+
+    void wait();
+
+private:
+    Scheduler* m_scheduler;
+    CancelToken::ptr m_token;
+    std::shared_ptr<State> m_state;
+};
+
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include "ioscheduler.h"
 #include "hook.h"
+#include "http.h"
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -178,8 +179,39 @@ void test_iomanager()
     iom.addEvent(sock_listen_fd, john::IOManager::READ, test_accept);
 }
 
+/*同样的服务用 john::HttpServer 实现：为每个连接创建一个协程，
+连接上的读写通过hook在数据未就绪时挂起协程，支持keep-alive和pipelining。*/
+void test_http_server()
+{
+    int portno = 8080;
+
+    john::HttpServer server([](const john::HttpRequest&, john::HttpResponse& rsp)
+    {
+        rsp.body = "Hello, World!";
+    });
+
+    if (server.bind(portno) < 0)
+    {
+        error("Error binding socket..\n");
+    }
+
+    printf("http server listening for connections on port: %d\n", portno);
+
+    //创建IOManager实例，工作线程自动开启hook；server先于iom定义，iom停止后才析构
+    john::IOManager iom(9, true, "IOManager", true);
+    server.start(&iom);
+}
+
+//默认运行基于IOManager事件回调的示例，参数为http时运行HttpServer示例
 int main(int argc, char *argv[])
 {
-    test_iomanager();
+    if (argc > 1 && strcmp(argv[1], "http") == 0)
+    {
+        test_http_server();
+    }
+    else
+    {
+        test_iomanager();
+    }
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,322 @@
+#include "../ioscheduler.h"
+#include "../hook.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <memory>
+
+/*用不加修改的poll()客户端压测do_poll。
+少量worker上跑大量客户端fiber，每个客户端自己设O_NONBLOCK，用poll等connect/send/recv，
+每轮结束就close，fd号会被别的客户端马上复用。
+每轮还会在另一个fiber已经阻塞recv的fd上poll，poll不能删掉那个fiber的登记，也不能卡住worker。
+要求所有客户端都完成、不卡死。
+
+编译(在6hook目录下)：
+g++ -O2 -std=c++17 tests/poll_clients.cpp $(ls *.cpp | grep -v test.cpp) -o poll_clients -ldl -lpthread
+运行：./poll_clients [客户端数=1000] [每个客户端的轮数=5] [worker数=4]
+全部完成返回0，超时或出错返回1*/
+
+static const int TIMEOUT_MS = 5000;      //单次poll的超时
+static const int DEADLINE_S = 60;        //整个测试的期限
+
+static std::atomic<int> g_done{0};       //完成全部轮次的客户端
+static std::atomic<int> g_failed{0};
+static std::atomic<int> g_timeouts{0};   //空闲socket上的短超时poll按预期返回0的次数
+static std::atomic<int> g_shared{0};     //和阻塞recv的fiber共用fd时poll之后recv仍被唤醒的次数
+static int g_port = 0;
+
+//等fd上的事件，超时或出错返回false
+static bool wait_fd(int fd, short events)
+{
+    struct pollfd p;
+    p.fd = fd;
+    p.events = events;
+    p.revents = 0;
+    int n = poll(&p, 1, TIMEOUT_MS);
+    return n == 1 && (p.revents & (events | POLLHUP | POLLERR));
+}
+
+//普通的非阻塞poll客户端：connect -> send -> recv回显 -> close
+static bool client_round(int id, int round)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0)
+    {
+        return false;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(g_port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    bool ok = false;
+    do
+    {
+        if(connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+        {
+            if(errno != EINPROGRESS || !wait_fd(fd, POLLOUT))
+            {
+                break;
+            }
+            int err = 0;
+            socklen_t len = sizeof(err);
+            if(getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0)
+            {
+                break;
+            }
+        }
+
+        //空闲连接上的短超时poll：超时定时器要在close之后失效，不能影响复用这个fd号的连接
+        struct pollfd idle;
+        idle.fd = fd;
+        idle.events = POLLIN;
+        idle.revents = 0;
+        if(poll(&idle, 1, 1) == 0)
+        {
+            ++g_timeouts;
+        }
+
+        char msg[64];
+        int len = snprintf(msg, sizeof(msg), "client %d round %d\n", id, round);
+        int sent = 0;
+        while(sent < len)
+        {
+            ssize_t n = send(fd, msg + sent, len - sent, 0);
+            if(n > 0)
+            {
+                sent += n;
+            }
+            else if(n < 0 && errno == EAGAIN && wait_fd(fd, POLLOUT))
+            {
+                continue;
+            }
+            else
+            {
+                break;
+            }
+        }
+        if(sent < len)
+        {
+            break;
+        }
+
+        char buf[64];
+        int got = 0;
+        while(got < len)
+        {
+            ssize_t n = recv(fd, buf + got, sizeof(buf) - got, 0);
+            if(n > 0)
+            {
+                got += n;
+            }
+            else if(n < 0 && errno == EAGAIN && wait_fd(fd, POLLIN))
+            {
+                continue;
+            }
+            else
+            {
+                break;
+            }
+        }
+        ok = got == len && memcmp(buf, msg, len) == 0;
+    } while(false);
+
+    close(fd);
+    return ok;
+}
+
+//另一个fiber阻塞在recv上时poll同一个fd，poll超时返回后recv必须还能被唤醒
+static bool shared_round()
+{
+    int sv[2], other[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    {
+        return false;
+    }
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, other) < 0)
+    {
+        close(sv[0]);
+        close(sv[1]);
+        return false;
+    }
+    auto started = std::make_shared<std::atomic<bool>>(false);
+    auto woke = std::make_shared<std::atomic<bool>>(false);
+    int rfd = sv[0];
+    john::IOManager::getThis()->schedulerLock([rfd, started, woke]()
+    {
+        //同一fd同一事件只能有一个等待者，抢在poll之后登记会得到EBUSY，稍后重试；
+        //如果poll泄漏了登记，这里会一直EBUSY，最终按超时失败
+        char c;
+        *started = true;
+        for(int i = 0; i < TIMEOUT_MS; ++i)
+        {
+            ssize_t n = recv(rfd, &c, 1, 0);
+            if(n == 1)
+            {
+                *woke = true;
+            }
+            if(n >= 0 || errno != EBUSY)
+            {
+                break;
+            }
+            usleep(1000);
+        }
+    });
+    //让读fiber先挂到fd上
+    while(!*started)
+    {
+        usleep(1000);
+    }
+    usleep(1000);
+
+    //只等被占用的fd：按时超时返回0
+    struct pollfd p[2];
+    p[0].fd = sv[0];
+    p[0].events = POLLIN;
+    p[0].revents = 0;
+    bool ok = poll(p, 1, 5) == 0;
+
+    //同时等另一个fd，它由别的fiber写入：poll不能占住worker，否则写入方可能永远得不到运行
+    int wfd = other[1];
+    john::IOManager::getThis()->schedulerLock([wfd]()
+    {
+        usleep(1000);
+        send(wfd, "y", 1, 0);
+    });
+    p[1] = p[0];
+    p[0].fd = other[0];
+    ok = ok && poll(p, 2, TIMEOUT_MS) == 1 && (p[0].revents & POLLIN) && p[1].revents == 0;
+
+    send(sv[1], "x", 1, 0);
+    for(int i = 0; i < TIMEOUT_MS && !*woke; ++i)
+    {
+        usleep(1000);
+    }
+    ok = ok && *woke;
+    if(ok)
+    {
+        ++g_shared;
+    }
+    close(sv[0]);
+    close(sv[1]);
+    close(other[0]);
+    close(other[1]);
+    return ok;
+}
+
+static void client(int id, int rounds)
+{
+    for(int r = 0; r < rounds; ++r)
+    {
+        if(!client_round(id, r) || !shared_round())
+        {
+            fprintf(stderr, "client %d failed in round %d: %s\n", id, r, strerror(errno));
+            ++g_failed;
+            return;
+        }
+    }
+    ++g_done;
+}
+
+//回显服务端，每个连接一个fiber，用hook后的阻塞read/write
+static void echo(int fd)
+{
+    char buf[256];
+    while(true)
+    {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if(n <= 0 || write(fd, buf, n) != n)
+        {
+            break;
+        }
+    }
+    close(fd);
+}
+
+static void server(int listen_fd)
+{
+    while(true)
+    {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if(fd < 0)
+        {
+            break;
+        }
+        john::IOManager::getThis()->schedulerLock(std::bind(echo, fd));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int clients = argc > 1 ? atoi(argv[1]) : 1000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 5;
+    int workers = argc > 3 ? atoi(argv[3]) : 4;
+
+    auto start = std::chrono::steady_clock::now();
+    john::IOManager iom(workers, false, "poll_clients", true);
+
+    //socket要在hook打开的fiber里创建，才会登记到FdMgr
+    std::atomic<int> listen_fd{-1};
+    iom.schedulerLock([&listen_fd]()
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if(bind(fd, (struct sockaddr*)&addr, len) < 0 || listen(fd, 4096) < 0
+           || getsockname(fd, (struct sockaddr*)&addr, &len) < 0)
+        {
+            perror("listen");
+            exit(1);
+        }
+        g_port = ntohs(addr.sin_port);
+        listen_fd = fd;
+        server(fd);
+    });
+    while(listen_fd < 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    for(int i = 0; i < clients; ++i)
+    {
+        iom.schedulerLock(std::bind(client, i, rounds));
+    }
+
+    auto deadline = start + std::chrono::seconds(DEADLINE_S);
+    while(g_done + g_failed < clients && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    printf("%d workers, %d clients x %d rounds: done=%d failed=%d idle_timeouts=%d shared_wakeups=%d in %lld ms\n",
+           workers, clients, rounds, g_done.load(), g_failed.load(), g_timeouts.load(), g_shared.load(), ms);
+
+    if(g_done != clients)
+    {
+        //卡住的客户端永远不会结束，stop()也会跟着卡住，直接退出
+        fprintf(stderr, "FAILED: %d clients did not complete\n", clients - g_done.load());
+        fflush(stdout);
+        _exit(1);
+    }
+    printf("OK\n");
+    fflush(stdout);
+    //accept fiber还挂在监听fd上，stop()等不到它结束，检查通过后直接退出
+    _exit(0);
+}
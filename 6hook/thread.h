@@ -4,6 +4,9 @@
 #include <mutex>
 #include <condition_variable>
 #include <functional>
+#include <atomic>
+#include <string>
+#include <sched.h>
 
 namespace john {
 
@@ -36,6 +39,33 @@ public:
     }
 };
 
+//自旋锁，只占一个字节，用于保护临界区很短的小对象（如每个fd的上下文）
+//满足BasicLockable，可以直接配合std::lock_guard使用
+class SpinLock {
+private:
+    std::atomic_flag flag = ATOMIC_FLAG_INIT;
+
+public:
+    void lock() {
+        int spins = 0;
+        while(flag.test_and_set(std::memory_order_acquire)) {
+            //持锁线程可能被抢占，自旋一段时间后主动让出CPU
+            if(++spins > 64) {
+                sched_yield();
+                spins = 0;
+            }
+        }
+    }
+
+    bool try_lock() {
+        return !flag.test_and_set(std::memory_order_acquire);
+    }
+
+    void unlock() {
+        flag.clear(std::memory_order_release);
+    }
+};
+
 class Thread {
 public:
     Thread(std::function<void()> cb, const std::string& name);
@@ -1,4 +1,5 @@
 #include "timer.h"
+#include <algorithm>
 
 namespace john {
 
@@ -143,35 +144,93 @@ std::shared_ptr<Timer> TimerManager::addConidtionTimer(uint64_t ms, std::functio
 }
 
 uint64_t TimerManager::getNextTimer() {
+    uint64_t us = getNextTimerUs();
+    return us == ~0ull ? ~0ull : us / 1000;
+}
+
+uint64_t TimerManager::getNextTimerUs() {
     std::shared_lock<std::shared_mutex> read_lock(m_mutex);
     
     // reset m_tickled
     //指示在定时器插入到时间堆时是否需要触发额外操作，比如唤醒一个等待线程
     m_tickled = false;
     
-    if (m_timers.empty())
+    if (m_timers.empty() && m_sleepers.empty())
     {
         // 返回最大值
         return ~0ull;
     }
 
-    //当前系统时间
-    auto now = std::chrono::system_clock::now();
-    //时间堆中第一个定时器的下一个定时器的超时时间
-    auto time = (*m_timers.begin())->m_next;
+    uint64_t next = ~0ull;
 
-    //判断当前时间是否已经超过时间堆中下一个定时器的超时时间
-    if(now>=time) 
+    if (!m_timers.empty())
     {
-        // 已经有timer超时则直接返回
-        return 0;
+        //当前系统时间
+        auto now = std::chrono::system_clock::now();
+        //时间堆中第一个定时器的下一个定时器的超时时间
+        auto time = (*m_timers.begin())->m_next;
+
+        //判断当前时间是否已经超过时间堆中下一个定时器的超时时间
+        if(now>=time) 
+        {
+            // 已经有timer超时则直接返回
+            return 0;
+        }
+        //没有timer超时，则计算当前时间到下一个超时时间的时间差
+        next = std::chrono::duration_cast<std::chrono::microseconds>(time - now).count();
     }
-    else
+
+    if (!m_sleepers.empty())
     {
-        //没有timer超时，则计算当前时间到下一个超时时间的时间差
-        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(time - now);
-        //将时间差转化位毫秒
-        return static_cast<uint64_t>(duration.count());            
+        auto now = std::chrono::steady_clock::now();
+        auto time = m_sleepers.front().deadline;
+        if(now>=time) 
+        {
+            return 0;
+        }
+        next = std::min<uint64_t>(next, std::chrono::duration_cast<std::chrono::microseconds>(time - now).count());
+    }
+
+    return next;
+}
+
+void TimerManager::addSleeper(std::chrono::steady_clock::time_point deadline, std::shared_ptr<Fiber> fiber) {
+    bool at_front = false;
+
+    {
+        std::unique_lock<std::shared_mutex> write_lock(m_mutex);
+        m_sleepers.push_back(Sleeper{deadline, std::move(fiber)});
+        std::push_heap(m_sleepers.begin(), m_sleepers.end());
+
+        //和addTimer一样，新条目成为最早到期的条目时唤醒idle协程更新epoll_wait超时
+        bool earliest = m_sleepers.front().deadline == deadline;
+        if (earliest && !m_timers.empty())
+        {
+            auto timer_left = (*m_timers.begin())->m_next - std::chrono::system_clock::now();
+            earliest = deadline - std::chrono::steady_clock::now() < timer_left;
+        }
+        at_front = earliest && !m_tickled;
+        if(at_front)
+        {
+            m_tickled = true;
+        }
+    }
+
+    if(at_front)
+    {
+        timerInsertedAtFront();
+    }
+}
+
+void TimerManager::listExpiredSleepers(std::vector<std::shared_ptr<Fiber>>& fibers) {
+    auto now = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::shared_mutex> write_lock(m_mutex);
+    while (!m_sleepers.empty() && m_sleepers.front().deadline <= now)
+    {
+        std::pop_heap(m_sleepers.begin(), m_sleepers.end());
+        fibers.push_back(std::move(m_sleepers.back().fiber));
+        m_sleepers.pop_back();
     }
 }
 
@@ -220,7 +279,7 @@ bool TimerManager::detectClockRollover() {
 //检测时间堆是否为空
 bool TimerManager::hasTimer() {
     std::shared_lock<std::shared_mutex> resd_lock(m_mutex);
-    return !m_timers.empty();
+    return !m_timers.empty() || !m_sleepers.empty();
 }
 
 }
\ No newline at end of file
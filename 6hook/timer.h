@@ -8,6 +8,8 @@
 #include <assert.h>
 #include <functional>
 #include <mutex>
+#include <chrono>
+#include "fiber.h"
 
 namespace john {
 
@@ -65,6 +67,15 @@ public:
 
     //拿到堆中最近的超时时间
     uint64_t getNextTimer();
+    //同上，精度为微秒，没有定时器时返回~0ull
+    uint64_t getNextTimerUs();
+
+    //让协程在绝对时间点deadline被唤醒，供sleep系列hook使用
+    //不创建Timer和回调，只在最小堆中放入一个条目，堆容量稳定后没有内存分配
+    void addSleeper(std::chrono::steady_clock::time_point deadline, std::shared_ptr<Fiber> fiber);
+
+    //取出所有已经到期的休眠协程
+    void listExpiredSleepers(std::vector<std::shared_ptr<Fiber>>& fibers);
 
     //处理所有已经超时的定时器的回调函数，处理定时器的循环逻辑
     void listExpiredTimerCb(std::vector<std::function<void()>>& cbs);
@@ -89,6 +100,16 @@ private:
     //时间堆
     std::set<std::shared_ptr<Timer>, Timer::Comparator> m_timers;
 
+    //休眠协程的条目，按唤醒时间组织成最小堆
+    struct Sleeper {
+        std::chrono::steady_clock::time_point deadline;
+        std::shared_ptr<Fiber> fiber;
+
+        //std::push_heap默认是最大堆，反过来比较得到最小堆
+        bool operator<(const Sleeper& rhs) const {return deadline > rhs.deadline;}
+    };
+    std::vector<Sleeper> m_sleepers;
+
     //时间器是否被唤醒的标志位
     bool m_tickled = false;
 